@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include "LevelInfo.h"
+#include "Usings.h"
+
+/* Call auction equilibrium */
+/*
+ * while a book is in its auction phase orders rest without matching and the book can cross
+ * at the uncross everything trades at one price, the one that executes the most:
+ *   demand(p) = bids at p or higher, supply(p) = asks at p or lower, volume(p) = min of the two
+ * ties go to the price that leaves the smallest surplus on either side, then to the price
+ * closest to the reference (the last trade), then to the lower price
+ *
+ * only level prices are candidates, between two of them demand and supply do not change
+ * so there is nothing better to find
+ */
+
+struct AuctionResult {
+    Price price_{};
+    std::uint64_t volume_{0}; // 0 when nothing crosses, price_ means nothing then
+    std::uint64_t surplus_{0}; // what is left on the bigger side at that price
+
+    bool operator==(const AuctionResult&) const = default;
+};
+
+/* is candidate a better uncross than best, by the rules above, lower prices win full ties by going first */
+inline bool BetterUncross(const AuctionResult& candidate, const AuctionResult& best, Price reference)
+{
+    auto Distance = [reference](Price price){
+        const std::int64_t distance = static_cast<std::int64_t>(price) - reference;
+        return distance < 0 ? -distance : distance;
+    };
+    if(candidate.volume_ != best.volume_)
+        return candidate.volume_ > best.volume_;
+    if(candidate.volume_ == 0)
+        return false;
+    if(candidate.surplus_ != best.surplus_)
+        return candidate.surplus_ < best.surplus_;
+    return Distance(candidate.price_) < Distance(best.price_);
+}
+
+/* asks lowest first and bids highest first, just the levels that cross (asks up to the best bid,
+ * bids down to the best ask), one pass over both merged by price
+ */
+inline AuctionResult FindEquilibrium(const LevelInfos& asks, const LevelInfos& bids, Price reference)
+{
+    AuctionResult best;
+    if(asks.empty() || bids.empty())
+        return best;
+
+    std::uint64_t totalDemand = 0;
+    for(const auto& bid : bids)
+        totalDemand += bid.quantity_;
+
+    std::uint64_t supply = 0, demandBelow = 0; // asks at or below p, bids below p
+    std::size_t ask = 0, bid = bids.size(); // bids are walked from the back, lowest first
+    while(ask < asks.size() || bid > 0){
+        Price price;
+        if(bid == 0) price = asks[ask].price_;
+        else if(ask == asks.size()) price = bids[bid - 1].price_;
+        else price = std::min(asks[ask].price_, bids[bid - 1].price_);
+
+        while(ask < asks.size() && asks[ask].price_ <= price)
+            supply += asks[ask++].quantity_;
+        const std::uint64_t demand = totalDemand - demandBelow;
+
+        const AuctionResult candidate{price, std::min(demand, supply), demand > supply ? demand - supply : supply - demand};
+        if(BetterUncross(candidate, best, reference))
+            best = candidate;
+
+        while(bid > 0 && bids[bid - 1].price_ <= price)
+            demandBelow += bids[--bid].quantity_;
+    }
+    return best;
+}
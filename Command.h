@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include "Order.h"
+#include "OrderModify.h"
+#include "OrderType.h"
+#include "PreTradeRisk.h"
+#include "Side.h"
+#include "Usings.h"
+
+/* A request to the book in a fixed size, trivially copyable form */
+/*
+ * this is what goes through the engine rings, so no pointers and no allocation
+ * fields a command type does not use are left at zero
+ * instrumentId_ picks the book, single book users can leave it at 0
+ * account_ is who an Add is for, only looked at when the book runs pre trade risk checks
+ * time_ is the deadline of a GoodTillTime add, or the clock an Expire runs at
+ * peak_ makes a GoodTillCancel / GoodForDay add an iceberg that shows that much at a time, 0 shows it all
+ * quantity_ of Expire / PruneGoodForDay caps how many orders go in that one step, 0 = all due
+ * AuctionStart / AuctionUncross go to the book of instrumentId_ like an Add does
+ * SetAccountLimits carries account_'s maxPosition_ in time_ and maxOpenNotional_ in orderId_, so the
+ * journal keeps limit changes in the same fixed size record
+ */
+
+enum class CommandType : std::uint8_t {
+    Add,
+    Cancel,
+    Modify,
+    PruneGoodForDay, // cancel every GoodForDay order now, in every book of the engine
+    Expire,          // cancel GoodTillTime orders whose deadline is at or before time_
+    AuctionStart,    // orders rest without matching until the uncross
+    AuctionUncross,  // trade everything that crosses at one price, back to continuous matching
+    SetAccountLimits, // pre trade risk limits of one account
+};
+
+struct Command {
+    CommandType type_{CommandType::Add};
+    OrderType orderType_{OrderType::GoodTillCancel};
+    Side side_{Side::Buy};
+    InstrumentId instrumentId_{};
+    OrderId orderId_{};
+    Price price_{};
+    Quantity quantity_{};
+    Timestamp time_{};
+    AccountId account_{};
+    Quantity peak_{};
+
+    static Command Add(const Order& order, InstrumentId instrumentId = 0){
+        return Command{CommandType::Add, order.GetOrderType(), order.GetSide(), instrumentId,
+                       order.GetOrderId(), order.GetPrice(), order.GetInitialQuantity(), order.GetExpiry(),
+                       order.GetAccount(), order.GetPeak()};
+    }
+    static Command Cancel(OrderId orderId, InstrumentId instrumentId = 0){
+        Command command;
+        command.type_ = CommandType::Cancel;
+        command.instrumentId_ = instrumentId;
+        command.orderId_ = orderId;
+        return command;
+    }
+    static Command Modify(const OrderModify& modify, InstrumentId instrumentId = 0){
+        return Command{CommandType::Modify, OrderType::GoodTillCancel, modify.GetSide(), instrumentId,
+                       modify.GetOrderId(), modify.GetPrice(), modify.GetQuantity(), Timestamp{}, AccountId{}, Quantity{}};
+    }
+    static Command PruneGoodForDay(Quantity maxOrders = 0){
+        Command command;
+        command.type_ = CommandType::PruneGoodForDay;
+        command.quantity_ = maxOrders;
+        return command;
+    }
+    static Command Expire(Timestamp now, Quantity maxOrders = 0){
+        Command command;
+        command.type_ = CommandType::Expire;
+        command.quantity_ = maxOrders;
+        command.time_ = now;
+        return command;
+    }
+
+    static Command AuctionStart(InstrumentId instrumentId = 0){
+        Command command;
+        command.type_ = CommandType::AuctionStart;
+        command.instrumentId_ = instrumentId;
+        return command;
+    }
+    static Command AuctionUncross(InstrumentId instrumentId = 0){
+        Command command;
+        command.type_ = CommandType::AuctionUncross;
+        command.instrumentId_ = instrumentId;
+        return command;
+    }
+
+    static Command SetAccountLimits(AccountId account, const AccountLimits& limits, InstrumentId instrumentId = 0){
+        Command command;
+        command.type_ = CommandType::SetAccountLimits;
+        command.instrumentId_ = instrumentId;
+        command.account_ = account;
+        command.time_ = limits.maxPosition_;
+        command.orderId_ = limits.maxOpenNotional_;
+        return command;
+    }
+
+    Order ToOrder() const {
+        if(peak_ != 0)
+            return Order::Iceberg(orderType_, orderId_, side_, price_, quantity_, peak_, account_);
+        return Order{orderType_, orderId_, side_, price_, quantity_, time_, account_};
+    }
+    OrderModify ToOrderModify() const {return OrderModify{orderId_, side_, price_, quantity_};}
+    AccountLimits ToAccountLimits() const {return AccountLimits{time_, orderId_};}
+};
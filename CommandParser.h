@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "Command.h"
+
+/* Zero copy parser for the A / M / C text format */
+/*
+ *   A <B|S> <FillAndKill|FillOrKill|Market> <price> <quantity> <orderId>
+ *   A <B|S> <GoodTillCancel|GoodForDay> <price> <quantity> <orderId> [<peak>]   with a peak it is an iceberg
+ *   A <B|S> GoodTillTime <price> <quantity> <orderId> <expiry>
+ *   M <orderId> <B|S> <price> <quantity>
+ *   C <orderId>
+ *   P                      prune GoodForDay orders, what happens at the close
+ *   E <now>                expire GoodTillTime orders due at now
+ *   S                      start a call auction, orders rest without matching
+ *   U                      uncross the auction and go back to continuous matching
+ *   L <account> <maxPosition> <maxOpenNotional>   pre trade risk limits of an account
+ *
+ * times are nanoseconds since the epoch
+ *
+ * same format as the test files, so their R result lines, blank lines and # comments are skipped
+ * it walks a buffer it does not own (usually a mapped file) with string_views and from_chars,
+ * nothing is copied or allocated per line
+ *
+ * when the buffer is a chunk of a stream pass complete = false, the parser then stops before
+ * a last line that has no newline yet and Rest() is what to carry over into the next chunk
+ */
+
+class CommandParser {
+public:
+    explicit CommandParser(std::string_view text, bool complete = true, std::size_t firstLine = 1)
+    : text_{text}, complete_{complete}, line_{firstLine}
+    {}
+
+    /* false once there is no full line left, throws std::invalid_argument on a bad line */
+    bool Next(Command& command){
+        while(!text_.empty()){
+            auto end = text_.find('\n');
+            if(end == std::string_view::npos){
+                if(!complete_)
+                    return false;
+                end = text_.size();
+            }
+
+            std::string_view line = text_.substr(0, end);
+            text_.remove_prefix(end == text_.size() ? end : end + 1);
+            if(!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+
+            const bool parsed = ParseLine(line, command);
+            ++line_;
+            if(parsed)
+                return true;
+        }
+        return false;
+    }
+
+    std::string_view Rest() const {return text_;}
+    /* number of the next line to be read */
+    std::size_t Line() const {return line_;}
+
+private:
+    bool ParseLine(std::string_view line, Command& command) const {
+        const std::string_view action = Token(line);
+        if(action.empty() || action[0] == '#' || action == "R")
+            return false;
+
+        command = Command{};
+        if(action == "A"){
+            command.type_ = CommandType::Add;
+            command.side_ = ParseSide(Token(line));
+            command.orderType_ = ParseOrderType(Token(line));
+            command.price_ = Number<Price>(Token(line), "price");
+            command.quantity_ = Number<Quantity>(Token(line), "quantity");
+            command.orderId_ = Number<OrderId>(Token(line), "order id");
+            if(command.orderType_ == OrderType::GoodTillTime)
+                command.time_ = Number<Timestamp>(Token(line), "expiry");
+            else if(command.orderType_ == OrderType::GoodTillCancel || command.orderType_ == OrderType::GoodForDay){
+                const std::string_view peak = Token(line);
+                if(!peak.empty() && (command.peak_ = Number<Quantity>(peak, "peak")) == 0)
+                    Fail("bad peak");
+            }
+        }
+        else if(action == "M"){
+            command.type_ = CommandType::Modify;
+            command.orderId_ = Number<OrderId>(Token(line), "order id");
+            command.side_ = ParseSide(Token(line));
+            command.price_ = Number<Price>(Token(line), "price");
+            command.quantity_ = Number<Quantity>(Token(line), "quantity");
+        }
+        else if(action == "C"){
+            command.type_ = CommandType::Cancel;
+            command.orderId_ = Number<OrderId>(Token(line), "order id");
+        }
+        else if(action == "P"){
+            command.type_ = CommandType::PruneGoodForDay;
+        }
+        else if(action == "E"){
+            command.type_ = CommandType::Expire;
+            command.time_ = Number<Timestamp>(Token(line), "time");
+        }
+        else if(action == "S"){
+            command.type_ = CommandType::AuctionStart;
+        }
+        else if(action == "U"){
+            command.type_ = CommandType::AuctionUncross;
+        }
+        else if(action == "L"){
+            const auto account = Number<AccountId>(Token(line), "account");
+            const auto maxPosition = Number<std::int64_t>(Token(line), "max position");
+            const auto maxOpenNotional = Number<std::uint64_t>(Token(line), "max open notional");
+            command = Command::SetAccountLimits(account, AccountLimits{maxPosition, maxOpenNotional});
+        }
+        else{
+            Fail("unknown action");
+        }
+
+        if(!Token(line).empty())
+            Fail("too many fields");
+        return true;
+    }
+
+    /* next space separated field, eats it off the front of the line */
+    static std::string_view Token(std::string_view& line){
+        const auto begin = line.find_first_not_of(" \t");
+        if(begin == std::string_view::npos){
+            line = {};
+            return {};
+        }
+        line.remove_prefix(begin);
+        const auto end = std::min(line.find_first_of(" \t"), line.size());
+        const std::string_view token = line.substr(0, end);
+        line.remove_prefix(end);
+        return token;
+    }
+
+    template<typename T>
+    T Number(std::string_view token, const char* what) const {
+        T value{};
+        const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+        if(token.empty() || error != std::errc{} || end != token.data() + token.size())
+            Fail(std::string{"bad "} + what);
+        return value;
+    }
+
+    Side ParseSide(std::string_view token) const {
+        if(token == "B") return Side::Buy;
+        if(token == "S") return Side::Sell;
+        Fail("bad side");
+    }
+
+    OrderType ParseOrderType(std::string_view token) const {
+        if(token == "GoodTillCancel") return OrderType::GoodTillCancel;
+        if(token == "FillAndKill") return OrderType::FillAndKill;
+        if(token == "FillOrKill") return OrderType::FillOrKill;
+        if(token == "GoodForDay") return OrderType::GoodForDay;
+        if(token == "Market") return OrderType::Market;
+        if(token == "GoodTillTime") return OrderType::GoodTillTime;
+        Fail("bad order type");
+    }
+
+    [[noreturn]] void Fail(const std::string& what) const {
+        throw std::invalid_argument("line " + std::to_string(line_) + ": " + what);
+    }
+
+    std::string_view text_;
+    bool complete_;
+    std::size_t line_;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include "LevelInfo.h"
+
+/* Every level of both sides as the book last published them (see Orderbook::ReadDepth) */
+/*
+ * bids best (highest) first, asks best (lowest) first, one entry per level with its total quantity
+ * version_ goes up by one per publish, readers can tell whether anything changed since they last looked
+ */
+
+struct DepthSnapshot {
+    LevelInfos bids_;
+    LevelInfos asks_;
+    std::uint64_t version_{0};
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+/* One writer swaps in immutable Ts, any number of readers hold on to one while they look at it */
+/*
+ * read copy update: the writer fills a T nobody can see, swaps the pointer to it in and retires
+ * the one it replaced, readers load the pointer and read the T in place, no copy and no lock
+ *
+ * a retired T is only reused once no reader can still be on it (epoch based reclamation):
+ * a reader announces the epoch it started in, in a slot of its own, before loading the pointer
+ * and clears the slot when it is done, the writer bumps the epoch on every swap and reuses what
+ * it retired before the oldest epoch still announced
+ *
+ * each thread keeps to its own slot (its own cache line), so readers never write anything another
+ * reader or the writer reads on their path, a thread only moves on to another slot while the one
+ * it prefers is taken, with more readers at once than slots they wait for one to clear
+ *
+ * retired Ts go back to the writer, Prepare hands them out again with whatever they held,
+ * so once a few are warm publishing does not allocate
+ * readers have to be gone before the publisher is
+ */
+
+template<typename T>
+class EpochPublisher {
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> epoch_{0}; // 0 while no reader is in it
+    };
+
+public:
+    static constexpr std::size_t DefaultReaderSlots = 64;
+
+    explicit EpochPublisher(std::size_t readerSlots = DefaultReaderSlots)
+    : slots_(std::max<std::size_t>(readerSlots, 1)),
+      current_{new T{}}
+    {}
+    ~EpochPublisher(){
+        delete current_.load(std::memory_order_relaxed);
+        delete prepared_;
+        for(auto& retired : retired_)
+            delete retired.first;
+        for(T* spare : spare_)
+            delete spare;
+    }
+    EpochPublisher(const EpochPublisher&) = delete;
+    EpochPublisher& operator=(const EpochPublisher&) = delete;
+
+    /* keeps one published T alive, hold it for as long as the reading takes and no longer */
+    class Reader {
+    public:
+        ~Reader(){ slot_->epoch_.store(0, std::memory_order_release); }
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        const T& operator*() const {return *value_;}
+        const T* operator->() const {return value_;}
+
+    private:
+        friend class EpochPublisher;
+        Reader(Slot* slot, const T* value) : slot_{slot}, value_{value} {}
+        Slot* slot_;
+        const T* value_;
+    };
+
+    Reader Read() const {
+        const std::size_t home = ThreadSlotHint();
+        for(std::size_t probe = 0;; ++probe){
+            Slot& slot = slots_[(home + probe) % slots_.size()];
+            std::uint64_t idle = 0;
+            // the announce has to be visible before the pointer is loaded, hence seq_cst on both
+            if(slot.epoch_.load(std::memory_order_relaxed) == 0 &&
+               slot.epoch_.compare_exchange_strong(idle, epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst))
+                return Reader{&slot, current_.load(std::memory_order_seq_cst)};
+#if defined(__x86_64__) || defined(_M_X64)
+            if(probe + 1 >= slots_.size())
+                _mm_pause();
+#endif
+        }
+    }
+
+    /* writer only: the next T to publish, a recycled one still holding an older value or a new one */
+    T& Prepare(){
+        if(prepared_ == nullptr){
+            if(spare_.empty())
+                prepared_ = new T{};
+            else {
+                prepared_ = spare_.back();
+                spare_.pop_back();
+            }
+        }
+        return *prepared_;
+    }
+
+    /* writer only: what Prepare returned becomes what readers get */
+    void Publish(){
+        T* value = std::exchange(prepared_, nullptr);
+        if(value == nullptr)
+            value = new T{};
+        T* replaced = current_.exchange(value, std::memory_order_seq_cst);
+        retired_.emplace_back(replaced, epoch_.load(std::memory_order_relaxed));
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        Reclaim();
+    }
+
+    /* writer only: the T readers get now */
+    const T& Current() const {return *current_.load(std::memory_order_relaxed);}
+
+    /* writer only: retired Ts a reader may still be on */
+    std::size_t Retired() const {return retired_.size();}
+
+private:
+    static std::size_t ThreadSlotHint(){
+        static std::atomic<std::size_t> nextThread{0};
+        thread_local const std::size_t hint = nextThread.fetch_add(1, std::memory_order_relaxed);
+        return hint;
+    }
+
+    /* a reader that announced epoch e may be on anything retired in epoch e or later */
+    void Reclaim(){
+        std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+        for(const Slot& slot : slots_){
+            const std::uint64_t epoch = slot.epoch_.load(std::memory_order_seq_cst);
+            if(epoch != 0)
+                oldest = std::min(oldest, epoch);
+        }
+
+        std::size_t kept = 0;
+        for(auto& retired : retired_){
+            if(retired.second < oldest)
+                spare_.push_back(retired.first);
+            else
+                retired_[kept++] = retired;
+        }
+        retired_.resize(kept);
+    }
+
+    mutable std::vector<Slot> slots_;
+    std::atomic<T*> current_;
+    std::atomic<std::uint64_t> epoch_{1}; // 0 marks an idle slot
+
+    // the writer's own, readers never look at these
+    T* prepared_{nullptr};
+    std::vector<std::pair<T*, std::uint64_t>> retired_; // with the epoch it was retired in
+    std::vector<T*> spare_;
+};
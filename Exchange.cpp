@@ -0,0 +1,148 @@
+#include "Exchange.h"
+
+#include <stdexcept>
+
+Exchange::Exchange(const ExchangeConfig& config)
+{
+    const std::size_t shards = config.shards_ == 0 ? 1 : config.shards_;
+    shards_.reserve(shards);
+
+    for(std::size_t i = 0; i < shards; ++i){
+        MatchingEngineConfig engine = config.engine_;
+        if(config.firstCpu_.has_value())
+            engine.cpu_ = *config.firstCpu_ + static_cast<int>(i);
+        shards_.push_back(std::make_unique<MatchingEngine>(engine));
+    }
+}
+
+void Exchange::AddInstrument(InstrumentId instrumentId)
+{
+    if(routes_.contains(instrumentId))
+        return;
+    AddInstrument(instrumentId, nextShard_);
+    nextShard_ = (nextShard_ + 1) % shards_.size();
+}
+
+void Exchange::AddInstrument(InstrumentId instrumentId, std::size_t shard)
+{
+    if(shard >= shards_.size())
+        throw std::out_of_range("Exchange has no such shard.");
+    if(routes_.contains(instrumentId))
+        return;
+
+    shards_[shard]->AddInstrument(instrumentId); // throws if that shard is running
+    routes_.emplace(instrumentId, shard);
+}
+
+Exchange::Session& Exchange::OpenSession()
+{
+    std::scoped_lock sessionsLock{sessionsMutex_};
+
+    std::vector<MatchingEngine::Session*> shardSessions;
+    shardSessions.reserve(shards_.size());
+    for(auto& shard : shards_)
+        shardSessions.push_back(&shard->OpenSession());
+
+    sessions_.push_back(std::unique_ptr<Session>{new Session{*this, std::move(shardSessions)}});
+    return *sessions_.back();
+}
+
+void Exchange::Start()
+{
+    for(auto& shard : shards_)
+        shard->Start();
+}
+
+void Exchange::Stop()
+{
+    for(auto& shard : shards_)
+        shard->Stop();
+}
+
+std::optional<std::size_t> Exchange::ShardOf(InstrumentId instrumentId) const
+{
+    auto route = routes_.find(instrumentId);
+    if(route == routes_.end())
+        return std::nullopt;
+    return route->second;
+}
+
+std::vector<EngineStats> Exchange::Stats() const
+{
+    std::vector<EngineStats> stats;
+    stats.reserve(shards_.size());
+    for(const auto& shard : shards_)
+        stats.push_back(shard->Stats());
+    return stats;
+}
+
+const SingleThreadedOrderbook& Exchange::Book(InstrumentId instrumentId) const
+{
+    return shards_[routes_.at(instrumentId)]->Book(instrumentId);
+}
+
+/* Session */
+MatchingEngine::Session* Exchange::Session::Route(InstrumentId instrumentId) const
+{
+    const auto shard = exchange_.ShardOf(instrumentId);
+    if(!shard.has_value())
+        return nullptr;
+    return shards_[*shard];
+}
+
+bool Exchange::Session::TrySubmit(const Command& command)
+{
+    // not one shard's business, see PruneGoodForDay() / ExpireOrders()
+    if(command.type_ == CommandType::PruneGoodForDay || command.type_ == CommandType::Expire)
+        return false;
+
+    auto* shard = Route(command.instrumentId_);
+    return shard != nullptr && shard->TrySubmit(command);
+}
+
+bool Exchange::Session::TryPoll(ExecutionReport& report)
+{
+    for(std::size_t i = 0; i < shards_.size(); ++i){
+        auto* shard = shards_[nextPoll_];
+        nextPoll_ = (nextPoll_ + 1) % shards_.size();
+        if(shard->TryPoll(report))
+            return true;
+    }
+    return false;
+}
+
+Trades Exchange::Session::AddOrder(InstrumentId instrumentId, const Order& order)
+{
+    auto* shard = Route(instrumentId);
+    if(shard == nullptr)
+        return Trades{};
+    return shard->AddOrder(order, instrumentId);
+}
+
+bool Exchange::Session::CancelOrder(InstrumentId instrumentId, OrderId orderId)
+{
+    auto* shard = Route(instrumentId);
+    return shard != nullptr && shard->CancelOrder(orderId, instrumentId);
+}
+
+void Exchange::Session::PruneGoodForDay()
+{
+    ExecutionReport final;
+    for(auto* shard : shards_)
+        shard->Execute(Command::PruneGoodForDay(), final);
+}
+
+void Exchange::Session::ExpireOrders(Timestamp now)
+{
+    ExecutionReport final;
+    for(auto* shard : shards_)
+        shard->Execute(Command::Expire(now), final);
+}
+
+Trades Exchange::Session::ModifyOrder(InstrumentId instrumentId, const OrderModify& order)
+{
+    auto* shard = Route(instrumentId);
+    if(shard == nullptr)
+        return Trades{};
+    return shard->ModifyOrder(order, instrumentId);
+}
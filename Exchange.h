@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "Command.h"
+#include "ExecutionReport.h"
+#include "MatchingEngine.h"
+#include "OrderbookConfig.h"
+
+/* Exchange */
+/*
+ * many instruments spread over N shards, each shard is a MatchingEngine with its
+ * own thread that owns its books outright, so shards never share state
+ *
+ * instruments are placed round robin unless a shard is given, commands are routed
+ * to the shard that owns their instrument
+ * a producer opens one Exchange::Session which holds a ring pair on every shard
+ */
+
+struct ExchangeConfig {
+    std::size_t shards_ = 4;
+    MatchingEngineConfig engine_{};
+    std::optional<int> firstCpu_; // pin shard i to core firstCpu_ + i
+
+    ExchangeConfig(){
+        // thousands of books per shard, keep each one small until it proves busy
+        engine_.book_.orderCapacity_ = 256;
+        engine_.book_.ladderLevels_ = 256;
+    }
+};
+
+class Exchange {
+public:
+    /* owned by one producer thread */
+    class Session {
+    public:
+        /* routed by command.instrumentId_, false when that shard's ring is full or the instrument is unknown
+         * PruneGoodForDay and Expire go to every shard so they are only available as PruneGoodForDay() / ExpireOrders()
+         */
+        bool TrySubmit(const Command& command);
+        /* reports from all shards, each shard keeps its own order */
+        bool TryPoll(ExecutionReport& report);
+
+        Trades AddOrder(InstrumentId instrumentId, const Order& order);
+        bool CancelOrder(InstrumentId instrumentId, OrderId orderId);
+        Trades ModifyOrder(InstrumentId instrumentId, const OrderModify& order);
+        /* blocking, returns once every shard has pruned */
+        void PruneGoodForDay();
+        /* blocking, returns once every shard has expired GoodTillTime orders due at now */
+        void ExpireOrders(Timestamp now);
+
+    private:
+        friend class Exchange;
+        Session(const Exchange& exchange, std::vector<MatchingEngine::Session*> shards)
+        : exchange_{exchange}, shards_{std::move(shards)}
+        {}
+
+        MatchingEngine::Session* Route(InstrumentId instrumentId) const;
+
+        const Exchange& exchange_;
+        std::vector<MatchingEngine::Session*> shards_;
+        std::size_t nextPoll_{0};
+    };
+
+    explicit Exchange(const ExchangeConfig& config = {});
+    Exchange(const Exchange&) = delete;
+    Exchange& operator=(const Exchange&) = delete;
+
+    /* only while stopped */
+    void AddInstrument(InstrumentId instrumentId);
+    void AddInstrument(InstrumentId instrumentId, std::size_t shard);
+
+    Session& OpenSession();
+
+    void Start();
+    void Stop();
+
+    std::size_t ShardCount() const {return shards_.size();}
+    std::optional<std::size_t> ShardOf(InstrumentId instrumentId) const;
+
+    /* one entry per shard */
+    std::vector<EngineStats> Stats() const;
+
+    /* only look at it while stopped */
+    const SingleThreadedOrderbook& Book(InstrumentId instrumentId) const;
+
+private:
+    std::vector<std::unique_ptr<MatchingEngine>> shards_;
+    std::unordered_map<InstrumentId, std::size_t> routes_; // read only once started
+    std::size_t nextShard_{0};
+
+    std::vector<std::unique_ptr<Session>> sessions_;
+    std::mutex sessionsMutex_;
+};
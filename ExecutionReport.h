@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include "TradeInfo.h"
+#include "Usings.h"
+
+/* What the engine sends back for a command */
+/*
+ * a command produces zero or more Trade reports followed by exactly one
+ * Accepted, Cancelled or Rejected report, which closes that command
+ */
+
+enum class ReportType : std::uint8_t {
+    Accepted,
+    Cancelled,
+    Rejected,
+    Trade,
+};
+
+enum class RejectReason : std::uint8_t {
+    None,
+    DuplicateOrderId,
+    UnknownOrder,
+    UnknownInstrument,
+    NoLiquidity, // market, FillAndKill or FillOrKill that could not trade
+    AuctionPhase, // market, FillAndKill or FillOrKill while the book is in a call auction
+    InvalidIceberg, // a peak on an order type that cannot be an iceberg
+    // pre trade risk (see PreTradeRisk.h)
+    UnknownAccount,
+    OrderTooLarge,
+    PriceBand,
+    PositionLimit,
+    NotionalLimit,
+};
+
+/* what one command of a batch came to, see BasicOrderbook::ApplyBatch
+ * fills_ is how many trades it sent to the sink, a batch's trades come in command order
+ */
+struct CommandResult {
+    RejectReason reason_{RejectReason::None};
+    std::uint32_t fills_{0};
+};
+
+struct ExecutionReport {
+    ReportType type_{ReportType::Accepted};
+    RejectReason reason_{RejectReason::None};
+    InstrumentId instrumentId_{};
+    OrderId orderId_{};
+    // only set for Trade reports
+    TradeInfo bidTrade_{};
+    TradeInfo askTrade_{};
+
+    bool IsFinal() const {return type_ != ReportType::Trade;}
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <memory>
+#include <new>
+#include <vector>
+#include "Usings.h"
+
+/* Deadlines of the resting orders that can expire */
+/*
+ * GoodTillTime orders are kept by their deadline, GoodForDay orders all share the
+ * EndOfSession key, so finding what expires costs the orders that expire and never
+ * a walk over the whole book
+ *
+ * the book keeps the handle of every scheduled order, a cancel or a fill unschedules
+ * it right away so nothing stale piles up until its deadline
+ * orders with the same deadline come out in the order they were scheduled, so a replay
+ * of the same commands expires the same orders in the same batches
+ *
+ * the map's nodes come out of slabs and go back on a free list (like OrderPool), so once the
+ * index has held as many orders as it holds now, scheduling and unscheduling do not allocate
+ */
+
+/* fixed size blocks carved out of slabs, never given back until the pool goes */
+class BlockPool {
+public:
+    static constexpr std::size_t SlabBlocks = 1024;
+
+    BlockPool() = default;
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+
+    /* blocks of the first size asked for are pooled, anything else goes to the heap */
+    void* Acquire(std::size_t size){
+        if(blockSize_ == 0)
+            blockSize_ = RoundUp(size);
+        if(RoundUp(size) != blockSize_)
+            return ::operator new(size);
+        if(free_ == nullptr)
+            Grow();
+        Free* block = free_;
+        free_ = block->next_;
+        return block;
+    }
+    void Release(void* block, std::size_t size){
+        if(RoundUp(size) != blockSize_){
+            ::operator delete(block);
+            return;
+        }
+        free_ = new(block) Free{free_};
+    }
+
+    /* blocks held in slabs, in use or free */
+    std::size_t Capacity() const {return slabs_.size() * SlabBlocks;}
+
+private:
+    struct Free {
+        Free* next_;
+    };
+
+    static std::size_t RoundUp(std::size_t size){
+        constexpr std::size_t align = alignof(std::max_align_t);
+        size = std::max(size, sizeof(Free));
+        return (size + align - 1) / align * align;
+    }
+
+    void Grow(){
+        slabs_.push_back(std::make_unique<std::max_align_t[]>(blockSize_ * SlabBlocks / sizeof(std::max_align_t)));
+        auto* bytes = reinterpret_cast<unsigned char*>(slabs_.back().get());
+        // thread the slab backwards so blocks are handed out in address order
+        for(std::size_t i = SlabBlocks; i > 0; --i)
+            free_ = new(bytes + (i - 1) * blockSize_) Free{free_};
+    }
+
+    std::size_t blockSize_{0};
+    Free* free_{nullptr};
+    std::vector<std::unique_ptr<std::max_align_t[]>> slabs_;
+};
+
+/* lets a node based container take its nodes from a BlockPool */
+template<typename T>
+class PooledAllocator {
+public:
+    using value_type = T;
+
+    explicit PooledAllocator(BlockPool* pool) : pool_{pool} {}
+    template<typename U>
+    PooledAllocator(const PooledAllocator<U>& other) : pool_{other.pool_} {}
+
+    T* allocate(std::size_t count){
+        if(count != 1)
+            return std::allocator<T>{}.allocate(count);
+        return static_cast<T*>(pool_->Acquire(sizeof(T)));
+    }
+    void deallocate(T* pointer, std::size_t count){
+        if(count != 1)
+            std::allocator<T>{}.deallocate(pointer, count);
+        else
+            pool_->Release(pointer, sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const PooledAllocator<U>& other) const {return pool_ == other.pool_;}
+
+private:
+    template<typename U> friend class PooledAllocator;
+    BlockPool* pool_;
+};
+
+class ExpiryIndex {
+public:
+    using Deadlines = std::multimap<Timestamp, OrderId, std::less<Timestamp>,
+                                    PooledAllocator<std::pair<const Timestamp, OrderId>>>;
+    using Handle = Deadlines::iterator;
+    static constexpr Timestamp EndOfSession = std::numeric_limits<Timestamp>::max();
+
+    ExpiryIndex() = default;
+    // the map's allocator points at pool_
+    ExpiryIndex(const ExpiryIndex&) = delete;
+    ExpiryIndex& operator=(const ExpiryIndex&) = delete;
+
+    /* handle of orders that are not scheduled */
+    Handle None() {return deadlines_.end();}
+
+    Handle Schedule(Timestamp deadline, OrderId orderId){
+        return deadlines_.emplace(deadline, orderId);
+    }
+
+    void Cancel(Handle handle){
+        if(handle != deadlines_.end())
+            deadlines_.erase(handle);
+    }
+
+    /* earliest deadline, EndOfSession when only GoodForDay orders (or nothing) are left */
+    Timestamp NextDeadline() const {
+        return deadlines_.empty() ? EndOfSession : deadlines_.begin()->first;
+    }
+
+    /* append up to maxOrders ids with a deadline at or before now, earliest first
+     * they stay scheduled, cancelling the orders is what unschedules them
+     */
+    std::size_t Due(Timestamp now, std::size_t maxOrders, OrderIds& orderIds) const {
+        now = std::min(now, EndOfSession - 1); // GoodForDay orders only go at the close
+        return Collect(deadlines_.begin(), [now](Timestamp deadline){return deadline <= now;}, maxOrders, orderIds);
+    }
+
+    /* append up to maxOrders GoodForDay ids, oldest first */
+    std::size_t DueAtClose(std::size_t maxOrders, OrderIds& orderIds) const {
+        return Collect(deadlines_.lower_bound(EndOfSession), [](Timestamp){return true;}, maxOrders, orderIds);
+    }
+
+    /* map nodes the pool holds, in use or free */
+    std::size_t Capacity() const {return pool_.Capacity();}
+
+private:
+    template<typename Predicate>
+    std::size_t Collect(Deadlines::const_iterator entry, Predicate due, std::size_t maxOrders, OrderIds& orderIds) const {
+        std::size_t count = 0;
+        for(; entry != deadlines_.end() && count < maxOrders && due(entry->first); ++entry, ++count)
+            orderIds.push_back(entry->second);
+        return count;
+    }
+
+    BlockPool pool_; // before deadlines_, it has to outlive the map's nodes
+    Deadlines deadlines_{PooledAllocator<std::pair<const Timestamp, OrderId>>{&pool_}};
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Fenwick (binary indexed) tree over a fixed number of slots */
+/*
+ * point update and prefix sum are both O(log n)
+ * the ladder keeps one per side so "how much rests at this price or better" is a prefix sum
+ */
+
+class FenwickTree {
+public:
+    explicit FenwickTree(std::size_t size) : tree_(size + 1) {}
+
+    void Add(std::size_t index, std::int64_t delta){
+        for(std::size_t i = index + 1; i < tree_.size(); i += i & (~i + 1))
+            tree_[i] += delta;
+    }
+
+    /* sum of slots [0, count) */
+    std::int64_t PrefixSum(std::size_t count) const {
+        std::int64_t sum = 0;
+        for(std::size_t i = count; i > 0; i -= i & (~i + 1))
+            sum += tree_[i];
+        return sum;
+    }
+
+    std::size_t Size() const {return tree_.size() - 1;}
+
+private:
+    std::vector<std::int64_t> tree_; // 1 based
+};
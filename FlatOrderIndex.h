@@ -0,0 +1,133 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "Usings.h"
+
+/* Order id -> Entry, open addressing over one flat array */
+/*
+ * order ids are dense and go up within a session, so an id's home slot is just its low bits:
+ * while the live ids span less than the table they never collide and a lookup, a duplicate
+ * check or an erase touches the one slot the id maps to
+ * anything that does collide goes further along (linear probing, Robin Hood: an id that is further
+ * from its home slot takes the place of one that is closer and that one moves on), so every id sits
+ * after the ones homed before it and a probe can stop at the first entry closer to home than it is
+ * an erase shifts the entries after it back until one is at home or a slot is free, there are no
+ * tombstones, probes never get longer with churn and a run of ids that all sit at home (a busy
+ * stretch of dense ids) is not walked on every erase
+ *
+ * the table stays at most half full, reserve it for the orders the book expects and it only
+ * grows (a rehash) when more than that rest at once
+ * slots are value_types with first / second like the std maps, so the book reads the same
+ * whichever index its policy picks
+ *
+ * an erase moves other entries, iterators do not survive it
+ */
+
+template<typename Entry>
+class FlatOrderIndex {
+public:
+    struct value_type {
+        OrderId first{};
+        Entry second{};
+        bool used_{false};
+    };
+    using iterator = value_type*;
+    using const_iterator = const value_type*;
+
+    FlatOrderIndex() { Rehash(MinCapacity); }
+
+    iterator end() {return slots_.data() + slots_.size();}
+    const_iterator end() const {return slots_.data() + slots_.size();}
+
+    iterator find(OrderId orderId) {return slots_.data() + Find(orderId);}
+    const_iterator find(OrderId orderId) const {return slots_.data() + Find(orderId);}
+    bool contains(OrderId orderId) const {return find(orderId) != end();}
+
+    /* does nothing and returns the one already there if the id is taken */
+    std::pair<iterator, bool> emplace(OrderId orderId, const Entry& entry){
+        if(2 * (size_ + 1) > slots_.size())
+            Rehash(2 * slots_.size());
+
+        const std::size_t found = Find(orderId);
+        if(found != slots_.size())
+            return {&slots_[found], false};
+
+        value_type incoming{orderId, entry, true};
+        iterator placed = nullptr;
+        std::size_t slot = Home(orderId);
+        for(std::size_t distance = 0; slots_[slot].used_; slot = Next(slot), ++distance){
+            const std::size_t resident = Distance(slot);
+            if(resident < distance){
+                // the resident is closer to home, it moves on instead
+                std::swap(incoming, slots_[slot]);
+                if(placed == nullptr)
+                    placed = &slots_[slot];
+                distance = resident;
+            }
+        }
+        slots_[slot] = std::move(incoming);
+        ++size_;
+        return {placed != nullptr ? placed : &slots_[slot], true};
+    }
+
+    void erase(iterator position){
+        std::size_t hole = static_cast<std::size_t>(position - slots_.data());
+        // pull the entries after it back a slot, up to one that is already at home
+        for(std::size_t slot = Next(hole); slots_[slot].used_ && Distance(slot) != 0; slot = Next(slot)){
+            slots_[hole] = std::move(slots_[slot]);
+            hole = slot;
+        }
+        slots_[hole] = value_type{};
+        --size_;
+    }
+    std::size_t erase(OrderId orderId){
+        const auto position = find(orderId);
+        if(position == end())
+            return 0;
+        erase(position);
+        return 1;
+    }
+
+    /* room for count ids without a rehash */
+    void reserve(std::size_t count){
+        if(2 * count > slots_.size())
+            Rehash(std::bit_ceil(2 * count));
+    }
+
+    std::size_t size() const {return size_;}
+    bool empty() const {return size_ == 0;}
+
+private:
+    static constexpr std::size_t MinCapacity = 16;
+
+    std::size_t Home(OrderId orderId) const {return static_cast<std::size_t>(orderId) & mask_;}
+    std::size_t Next(std::size_t slot) const {return (slot + 1) & mask_;}
+    /* how far the entry in a used slot is from its home */
+    std::size_t Distance(std::size_t slot) const {return (slot - Home(slots_[slot].first)) & mask_;}
+
+    /* slot holding the id, slots_.size() when there is none */
+    std::size_t Find(OrderId orderId) const {
+        std::size_t slot = Home(orderId);
+        for(std::size_t distance = 0; slots_[slot].used_ && Distance(slot) >= distance; slot = Next(slot), ++distance)
+            if(slots_[slot].first == orderId)
+                return slot;
+        return slots_.size();
+    }
+
+    void Rehash(std::size_t capacity){
+        std::vector<value_type> old(capacity);
+        old.swap(slots_);
+        mask_ = capacity - 1;
+        size_ = 0;
+        for(auto& entry : old)
+            if(entry.used_)
+                emplace(entry.first, entry.second);
+    }
+
+    std::vector<value_type> slots_;
+    std::size_t mask_{0};
+    std::size_t size_{0};
+};
@@ -0,0 +1,126 @@
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr std::array<const char*, HotPathStageCount> StageNames = {
+    "lock", "journal", "admission", "insert", "level_update", "match",
+};
+
+/* live threads' histograms plus what exited threads left behind */
+struct Registry {
+    std::mutex mutex_;
+    std::vector<StageLatencies*> threads_;
+    StageLatencies retired_;
+};
+
+Registry& GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+/* ticks of Instrumentation::Now() per steady clock nanosecond, measured once over a few ms */
+double Calibrate()
+{
+    using namespace std::chrono;
+    const auto start = steady_clock::now();
+    const std::uint64_t startTicks = Instrumentation::Now();
+    std::this_thread::sleep_for(milliseconds(20));
+    const std::uint64_t ticks = Instrumentation::Now() - startTicks;
+    const auto nanoseconds = duration_cast<std::chrono::nanoseconds>(steady_clock::now() - start).count();
+    return nanoseconds > 0 ? static_cast<double>(ticks) / static_cast<double>(nanoseconds) : 1.0;
+}
+
+}
+
+const char* StageName(HotPathStage stage)
+{
+    return StageNames[static_cast<std::size_t>(stage)];
+}
+
+Instrumentation::ThreadLatencies::ThreadLatencies()
+{
+    auto& registry = GetRegistry();
+    std::scoped_lock lock{registry.mutex_};
+    registry.threads_.push_back(&latencies_);
+}
+
+Instrumentation::ThreadLatencies::~ThreadLatencies()
+{
+    auto& registry = GetRegistry();
+    std::scoped_lock lock{registry.mutex_};
+    for(std::size_t i = 0; i < HotPathStageCount; ++i)
+        registry.retired_.stages_[i].Merge(latencies_.stages_[i]);
+    std::erase(registry.threads_, &latencies_);
+}
+
+StageLatencies Instrumentation::Collect()
+{
+    auto& registry = GetRegistry();
+    std::scoped_lock lock{registry.mutex_};
+    StageLatencies merged = registry.retired_;
+    for(const StageLatencies* thread : registry.threads_)
+        for(std::size_t i = 0; i < HotPathStageCount; ++i)
+            merged.stages_[i].Merge(thread->stages_[i]);
+    return merged;
+}
+
+void Instrumentation::Reset()
+{
+    auto& registry = GetRegistry();
+    std::scoped_lock lock{registry.mutex_};
+    registry.retired_ = StageLatencies{};
+    for(StageLatencies* thread : registry.threads_)
+        *thread = StageLatencies{};
+}
+
+double Instrumentation::TicksPerNanosecond()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    static const double ticksPerNanosecond = Calibrate();
+    return ticksPerNanosecond;
+#else
+    return 1.0;
+#endif
+}
+
+void Instrumentation::WriteText(std::ostream& out)
+{
+    const StageLatencies latencies = Collect();
+    const double scale = 1.0 / TicksPerNanosecond();
+    auto Ns = [scale](std::uint64_t ticks) {return static_cast<unsigned long long>(static_cast<double>(ticks) * scale);};
+
+    out << "stage             count      mean      p50      p99    p99.9        max  (ns)\n";
+    for(std::size_t i = 0; i < HotPathStageCount; ++i){
+        const LatencyHistogram& histogram = latencies.stages_[i];
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-12s %10llu %9.1f %8llu %8llu %8llu %10llu\n",
+                      StageNames[i], static_cast<unsigned long long>(histogram.Count()), histogram.Mean() * scale,
+                      Ns(histogram.Percentile(50)), Ns(histogram.Percentile(99)),
+                      Ns(histogram.Percentile(99.9)), Ns(histogram.Max()));
+        out << line;
+    }
+}
+
+void Instrumentation::WriteCsv(std::ostream& out)
+{
+    const StageLatencies latencies = Collect();
+    const double scale = 1.0 / TicksPerNanosecond();
+
+    out << "stage,count,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n";
+    for(std::size_t i = 0; i < HotPathStageCount; ++i){
+        const LatencyHistogram& histogram = latencies.stages_[i];
+        out << StageNames[i] << ',' << histogram.Count() << ',' << histogram.Mean() * scale
+            << ',' << static_cast<std::uint64_t>(static_cast<double>(histogram.Percentile(50)) * scale)
+            << ',' << static_cast<std::uint64_t>(static_cast<double>(histogram.Percentile(99)) * scale)
+            << ',' << static_cast<std::uint64_t>(static_cast<double>(histogram.Percentile(99.9)) * scale)
+            << ',' << static_cast<std::uint64_t>(static_cast<double>(histogram.Max()) * scale) << '\n';
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include "LatencyHistogram.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#endif
+
+/* Where the time goes inside AddOrder */
+/*
+ * build with -DORDERBOOK_INSTRUMENT=1 (make ... INSTRUMENT=1) and the add path stamps the clock
+ * at each stage boundary, one read per boundary, the gap goes into a histogram for the stage
+ * the default build compiles every Begin / Mark to nothing
+ *
+ * each thread records into its own histograms, nothing is shared or locked while recording
+ * Collect merges every thread's (and those of threads that have exited), read it when the
+ * recording threads are quiet, like after a bench run or with the engine stopped
+ *
+ * times are rdtsc ticks on x86 and steady clock nanoseconds elsewhere, the reports convert to ns
+ */
+
+#ifndef ORDERBOOK_INSTRUMENT
+#define ORDERBOOK_INSTRUMENT 0
+#endif
+
+enum class HotPathStage {
+    Lock,        // waiting for the book
+    Journal,     // duplicate check and journaling
+    Admission,   // market order pricing, CanMatch / CanFullyFill
+    Insert,      // pool node, level queue, id index, expiry index
+    LevelUpdate, // level aggregates for the added order
+    Match,       // MatchOrders, fills and their level updates included
+};
+constexpr std::size_t HotPathStageCount = 6;
+
+const char* StageName(HotPathStage stage);
+
+/* one histogram per stage, in clock ticks */
+struct StageLatencies {
+    std::array<LatencyHistogram, HotPathStageCount> stages_;
+
+    const LatencyHistogram& Of(HotPathStage stage) const {return stages_[static_cast<std::size_t>(stage)];}
+    LatencyHistogram& Of(HotPathStage stage) {return stages_[static_cast<std::size_t>(stage)];}
+};
+
+class Instrumentation {
+public:
+    static constexpr bool Enabled = ORDERBOOK_INSTRUMENT != 0;
+
+    /* start of an operation, the next Mark measures from here */
+    static void Begin(){
+        if constexpr(Enabled)
+            Local().last_ = Now();
+    }
+
+    /* end of a stage, the next one starts now */
+    static void Mark(HotPathStage stage){
+        if constexpr(Enabled){
+            auto& local = Local();
+            const std::uint64_t now = Now();
+            local.latencies_.Of(stage).Record(now - local.last_);
+            local.last_ = now;
+        }
+    }
+
+    /* every thread's histograms merged, still in ticks */
+    static StageLatencies Collect();
+    static void Reset();
+    static double TicksPerNanosecond();
+
+    /* p50 / p99 / p99.9 / max per stage in ns, as a table or as CSV with a header line */
+    static void WriteText(std::ostream& out);
+    static void WriteCsv(std::ostream& out);
+
+    static std::uint64_t Now(){
+#if defined(__x86_64__) || defined(_M_X64)
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+private:
+    /* registers itself on a thread's first Begin and hands its counts over when the thread exits */
+    struct ThreadLatencies {
+        ThreadLatencies();
+        ~ThreadLatencies();
+        StageLatencies latencies_;
+        std::uint64_t last_{0};
+    };
+
+    static ThreadLatencies& Local(){
+        thread_local ThreadLatencies local;
+        return local;
+    }
+};
@@ -0,0 +1,194 @@
+#include "Journal.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+/* file starts with this header so a reader can reject files it does not understand */
+struct JournalHeader {
+    char magic_[8];
+    std::uint32_t version_;
+    std::uint32_t recordSize_;
+    std::uint64_t reserved_[2];
+};
+static_assert(sizeof(JournalHeader) == 32);
+
+constexpr char Magic[8] = {'O', 'B', 'J', 'O', 'U', 'R', 'N', 'L'};
+constexpr std::uint32_t Version = 5; // 3 added the account, 4 the iceberg peak, 5 account limit changes
+
+[[noreturn]] void Fail(const std::string& what, const std::string& path)
+{
+    throw std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+bool ValidHeader(const JournalHeader& header)
+{
+    return std::memcmp(header.magic_, Magic, sizeof(Magic)) == 0
+        && header.version_ == Version
+        && header.recordSize_ == sizeof(JournalRecord);
+}
+
+}
+
+/* Records */
+JournalRecord JournalRecord::From(std::uint64_t sequence, const Command& command)
+{
+    return JournalRecord{
+        sequence,
+        command.orderId_,
+        command.price_,
+        command.quantity_,
+        command.instrumentId_,
+        static_cast<std::uint8_t>(command.type_),
+        static_cast<std::uint8_t>(command.orderType_),
+        static_cast<std::uint8_t>(command.side_),
+        0,
+        command.time_,
+        command.account_,
+        {},
+        command.peak_,
+    };
+}
+
+Command JournalRecord::ToCommand() const
+{
+    Command command;
+    command.type_ = static_cast<CommandType>(type_);
+    command.orderType_ = static_cast<OrderType>(orderType_);
+    command.side_ = static_cast<Side>(side_);
+    command.instrumentId_ = instrumentId_;
+    command.orderId_ = orderId_;
+    command.price_ = price_;
+    command.quantity_ = quantity_;
+    command.time_ = time_;
+    command.account_ = account_;
+    command.peak_ = peak_;
+    return command;
+}
+
+/* Writer */
+JournalWriter::JournalWriter(const JournalConfig& config)
+: config_{config}, lastSync_{std::chrono::steady_clock::now()}
+{
+    fd_ = ::open(config_.path_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if(fd_ < 0)
+        Fail("cannot open journal", config_.path_);
+
+    // the destructor does not run for a constructor that throws, give the descriptor back here
+    try{
+        Open();
+    }
+    catch(...){
+        ::close(fd_);
+        fd_ = -1;
+        throw;
+    }
+    batch_.reserve(config_.batchRecords_);
+}
+
+/* check or write the header, then pick up numbering after the records already there */
+void JournalWriter::Open()
+{
+    struct stat info{};
+    if(::fstat(fd_, &info) != 0)
+        Fail("cannot stat journal", config_.path_);
+
+    auto size = static_cast<std::uint64_t>(info.st_size);
+    if(size > 0 && size < sizeof(JournalHeader)){
+        // died while writing the header, nothing was journaled yet
+        if(::ftruncate(fd_, 0) != 0)
+            Fail("cannot truncate journal", config_.path_);
+        size = 0;
+    }
+
+    if(size == 0){
+        JournalHeader header{};
+        std::memcpy(header.magic_, Magic, sizeof(Magic));
+        header.version_ = Version;
+        header.recordSize_ = sizeof(JournalRecord);
+        if(::write(fd_, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header)))
+            Fail("cannot write journal header", config_.path_);
+    }
+    else{
+        JournalHeader header{};
+        if(::pread(fd_, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)))
+            Fail("cannot read journal header", config_.path_);
+        if(!ValidHeader(header))
+            throw std::runtime_error("journal " + config_.path_ + " has an unknown format, not appending to it");
+
+        // carry on numbering after what is already there
+        // a torn last record is cut off, appends would land out of step with the records otherwise
+        nextSequence_ = (size - sizeof(JournalHeader)) / sizeof(JournalRecord);
+        const auto whole = sizeof(JournalHeader) + nextSequence_ * sizeof(JournalRecord);
+        if(whole != size && ::ftruncate(fd_, static_cast<off_t>(whole)) != 0)
+            Fail("cannot truncate journal", config_.path_);
+    }
+}
+
+JournalWriter::~JournalWriter()
+{
+    try{
+        Flush();
+    }
+    catch(const std::exception&){
+        // nothing sensible to do in a destructor, the records are lost either way
+    }
+    if(fd_ >= 0)
+        ::close(fd_);
+}
+
+void JournalWriter::Flush()
+{
+    if(batch_.empty())
+        return;
+
+    const char* data = reinterpret_cast<const char*>(batch_.data());
+    std::size_t left = batch_.size() * sizeof(JournalRecord);
+    while(left > 0){
+        const ssize_t written = ::write(fd_, data, left);
+        if(written < 0){
+            if(errno == EINTR)
+                continue;
+            Fail("cannot write journal", config_.path_);
+        }
+        data += written;
+        left -= static_cast<std::size_t>(written);
+    }
+    batch_.clear();
+
+    const auto now = std::chrono::steady_clock::now();
+    const bool sync = config_.fsync_ == FsyncPolicy::EveryBatch
+        || (config_.fsync_ == FsyncPolicy::Periodic && now - lastSync_ >= config_.fsyncInterval_);
+    if(sync){
+        if(::fdatasync(fd_) != 0)
+            Fail("cannot sync journal", config_.path_);
+        lastSync_ = now;
+    }
+}
+
+/* Reader */
+JournalReader::JournalReader(const std::string& path)
+: file_{path}
+{
+    if(!IsJournal(file_.View()))
+        throw std::runtime_error("journal " + path + " has an unknown format");
+
+    records_ = reinterpret_cast<const JournalRecord*>(file_.Data() + sizeof(JournalHeader));
+    count_ = (file_.Size() - sizeof(JournalHeader)) / sizeof(JournalRecord);
+}
+
+bool JournalReader::IsJournal(std::string_view data)
+{
+    if(data.size() < sizeof(JournalHeader))
+        return false;
+    JournalHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    return ValidHeader(header);
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Command.h"
+#include "MappedFile.h"
+#include "Trade.h"
+
+/* Binary event journal */
+/*
+ * every command the book accepts is appended as one fixed size record, in the order
+ * the book processed them, so replaying the file rebuilds exactly the same book
+ *
+ * records are batched in memory and written with one write() per batch
+ * how often the file is fsynced is a policy, durability costs latency
+ *
+ * replay maps the whole file and walks the records in place, no parsing, no copies
+ */
+
+struct JournalRecord {
+    std::uint64_t sequence_;
+    std::uint64_t orderId_;
+    std::int32_t price_;
+    std::uint32_t quantity_;
+    std::uint32_t instrumentId_;
+    std::uint8_t type_;      // CommandType
+    std::uint8_t orderType_; // OrderType
+    std::uint8_t side_;      // Side
+    std::uint8_t reserved_;
+    std::int64_t time_;      // GoodTillTime deadline, or the clock of an Expire
+    std::uint16_t account_;  // AccountId of an Add
+    std::uint8_t padding_[2];
+    std::uint32_t peak_;     // iceberg peak of an Add, 0 for the rest
+
+    static JournalRecord From(std::uint64_t sequence, const Command& command);
+    Command ToCommand() const;
+};
+static_assert(sizeof(JournalRecord) == 48, "journal records are fixed size on disk");
+
+enum class FsyncPolicy {
+    Never,     // leave it to the OS, survives a process crash but not a machine crash
+    EveryBatch,
+    Periodic,  // at most once per fsyncInterval_
+};
+
+struct JournalConfig {
+    std::string path_;
+    std::size_t batchRecords_ = 4096;
+    FsyncPolicy fsync_ = FsyncPolicy::Never;
+    std::chrono::milliseconds fsyncInterval_{10};
+};
+
+class JournalWriter {
+public:
+    /* appends to an existing journal, sequence numbers carry on from its last record
+     * a torn last record (a crash mid write) is cut off first, a file that is not a journal of
+     * this version throws std::runtime_error
+     */
+    explicit JournalWriter(const JournalConfig& config);
+    ~JournalWriter();
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    void Append(const Command& command){
+        batch_.push_back(JournalRecord::From(nextSequence_++, command));
+        if(batch_.size() >= config_.batchRecords_)
+            Flush();
+    }
+
+    /* write the batch, fsync if the policy says so */
+    void Flush();
+
+    /* sequence the next record will get, also the number of records written so far */
+    std::uint64_t NextSequence() const {return nextSequence_;}
+
+private:
+    void Open();
+
+    JournalConfig config_;
+    int fd_{-1};
+    std::vector<JournalRecord> batch_;
+    std::uint64_t nextSequence_{0};
+    std::chrono::steady_clock::time_point lastSync_;
+};
+
+/* read only view of a journal file through mmap */
+class JournalReader {
+public:
+    explicit JournalReader(const std::string& path);
+
+    /* does the buffer start with a journal header */
+    static bool IsJournal(std::string_view data);
+
+    std::size_t Size() const {return count_;}
+    const JournalRecord* begin() const {return records_;}
+    const JournalRecord* end() const {return records_ + count_;}
+
+private:
+    MappedFile file_;
+    const JournalRecord* records_{nullptr};
+    std::size_t count_{0};
+};
+
+/* apply every record with sequence >= fromSequence, returns how many were applied
+ * the book (any BasicOrderbook) must not have a journal attached or it would journal the replay again
+ */
+template<typename Book>
+std::uint64_t ReplayJournal(const std::string& path, Book& orderbook, std::uint64_t fromSequence = 0)
+{
+    JournalReader reader{path};
+
+    std::uint64_t applied = 0;
+    for(const auto& record : reader){
+        if(record.sequence_ < fromSequence)
+            continue;
+        orderbook.Apply(record.ToCommand(), [](const Trade&){}); // the trades were reported the first time
+        ++applied;
+    }
+    return applied;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+/* HDR style latency histogram */
+/*
+ * values below 128 get their own bucket, above that every power of two is split into
+ * 64 linear sub buckets, so any recorded value is off by less than 1.6%
+ * recording is a bit_width, a shift and an increment, no allocation, fixed 30KB
+ *
+ * values are whatever unit the caller uses (nanoseconds, ticks)
+ */
+
+class LatencyHistogram {
+public:
+    void Record(std::uint64_t value){
+        ++counts_[IndexOf(value)];
+        ++count_;
+        sum_ += value;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void Merge(const LatencyHistogram& other){
+        for(std::size_t i = 0; i < Buckets; ++i)
+            counts_[i] += other.counts_[i];
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    void Reset(){ *this = LatencyHistogram{}; }
+
+    std::uint64_t Count() const {return count_;}
+    std::uint64_t Min() const {return count_ == 0 ? 0 : min_;}
+    std::uint64_t Max() const {return max_;}
+    double Mean() const {return count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_;}
+
+    /* percentile in [0, 100], reported as the top of its bucket but never above Max() */
+    std::uint64_t Percentile(double percentile) const {
+        if(count_ == 0)
+            return 0;
+        const double clamped = std::clamp(percentile, 0.0, 100.0);
+        auto target = static_cast<std::uint64_t>(clamped / 100.0 * static_cast<double>(count_) + 0.5);
+        target = std::clamp<std::uint64_t>(target, 1, count_);
+
+        std::uint64_t seen = 0;
+        for(std::size_t i = 0; i < Buckets; ++i){
+            seen += counts_[i];
+            if(seen >= target)
+                return std::min(HighestOf(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static constexpr unsigned SubBits = 7;                      // 128 exact values
+    static constexpr std::uint64_t HalfSub = 1u << (SubBits - 1); // 64 sub buckets per power of two
+    static constexpr std::size_t Buckets = (64 - SubBits + 1) * HalfSub + HalfSub;
+
+    static std::size_t IndexOf(std::uint64_t value){
+        if(value < (std::uint64_t{1} << SubBits))
+            return static_cast<std::size_t>(value);
+        const unsigned msb = std::bit_width(value) - 1;
+        const unsigned shift = msb - (SubBits - 1);
+        return static_cast<std::size_t>(shift * HalfSub + (value >> shift));
+    }
+
+    static std::uint64_t HighestOf(std::size_t index){
+        if(index < (std::size_t{1} << SubBits))
+            return index;
+        const unsigned shift = static_cast<unsigned>(index / HalfSub - 1);
+        const std::uint64_t sub = index - shift * HalfSub;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::array<std::uint64_t, Buckets> counts_{};
+    std::uint64_t count_{0};
+    std::uint64_t sum_{0};
+    std::uint64_t min_{std::numeric_limits<std::uint64_t>::max()};
+    std::uint64_t max_{0};
+};
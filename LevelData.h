@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Usings.h"
+
+/* Aggregates kept for every price level */
+/* total remaining quantity resting at the level and how many orders make it up
+ * quantity_ is what the level shows, hidden_ what icebergs keep behind their peaks on top of it,
+ * market data only ever gives out quantity_ but both trade
+ */
+
+struct LevelData{
+    Quantity quantity_{};
+    Quantity count_{};
+    Quantity hidden_{};
+
+    enum class Action {
+        ADD,
+        REMOVE,
+        MATCH,
+        REDUCE, // an amend took quantity off an order that stays
+        REFRESH // an iceberg showed its next peak, quantity moves from hidden to displayed
+    };
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+#include "Side.h"
+#include "Usings.h"
+
+/* Incremental L2 event */
+/*
+ * the new aggregates of one price level after an add, cancel or fill touched it,
+ * or once per level a snapshot load brought in
+ * quantity_ and count_ of 0 mean the level is gone
+ * applying them in order to a copy of GetDepth() keeps that copy equal to the book
+ */
+
+struct LevelUpdate {
+    Side side_;
+    Price price_;
+    Quantity quantity_;
+    Quantity count_;
+};
+
+using LevelUpdates = std::vector<LevelUpdate>;
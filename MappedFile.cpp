@@ -0,0 +1,46 @@
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+
+    struct stat info{};
+    if(::fstat(fd, &info) != 0){
+        const int error = errno;
+        ::close(fd);
+        throw std::runtime_error("cannot stat " + path + ": " + std::strerror(error));
+    }
+
+    size_ = static_cast<std::size_t>(info.st_size);
+    if(size_ == 0){ // mmap refuses empty mappings, an empty file is just an empty view
+        ::close(fd);
+        return;
+    }
+
+    void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int error = errno;
+    ::close(fd);
+    if(data == MAP_FAILED)
+        throw std::runtime_error("cannot map " + path + ": " + std::strerror(error));
+
+    // everything here is read front to back once
+    ::madvise(data, size_, MADV_SEQUENTIAL);
+    data_ = data;
+}
+
+MappedFile::~MappedFile()
+{
+    if(data_ != nullptr)
+        ::munmap(data_, size_);
+}
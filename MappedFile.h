@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/* Read only memory mapping of a whole file */
+/* the journal reader and the command driver walk their input in place through this */
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path); // throws std::runtime_error
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* Data() const {return static_cast<const char*>(data_);}
+    std::size_t Size() const {return size_;}
+    std::string_view View() const {return {Data(), size_};}
+
+private:
+    void* data_{nullptr};
+    std::size_t size_{0};
+};
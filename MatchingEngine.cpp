@@ -0,0 +1,307 @@
+#include "MatchingEngine.h"
+
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+/* after this many empty polls the matching thread starts yielding */
+constexpr std::size_t IdleSpins = 1 << 12;
+
+}
+
+MatchingEngine::MatchingEngine(const MatchingEngineConfig& config)
+: config_{config},
+  bookConfig_{config.book_},
+  sessions_{std::make_unique<std::unique_ptr<Session>[]>(config.maxSessions_)}
+{}
+
+MatchingEngine::~MatchingEngine()
+{
+    Stop();
+}
+
+void MatchingEngine::AddInstrument(InstrumentId instrumentId)
+{
+    if(matchingThread_.joinable())
+        throw std::logic_error("MatchingEngine instruments can only be added while it is stopped.");
+    if(books_.contains(instrumentId))
+        return;
+
+    books_.emplace(instrumentId, Instrument{std::make_unique<SingleThreadedOrderbook>(bookConfig_)});
+    instrumentCount_.store(books_.size(), std::memory_order_relaxed);
+}
+
+MatchingEngine::Session& MatchingEngine::OpenSession()
+{
+    std::scoped_lock sessionsLock{sessionsMutex_};
+
+    const std::size_t index = sessionCount_.load(std::memory_order_relaxed);
+    if(index == config_.maxSessions_)
+        throw std::logic_error("MatchingEngine has no room for another session.");
+
+    sessions_[index] = std::make_unique<Session>(config_.queueCapacity_);
+    sessionCount_.store(index + 1, std::memory_order_release); // publish it to the matching thread
+    return *sessions_[index];
+}
+
+void MatchingEngine::Start()
+{
+    if(matchingThread_.joinable())
+        return;
+    stopping_.store(false, std::memory_order_release);
+    matchingThread_ = std::thread{[this] {Run();}};
+}
+
+void MatchingEngine::Stop()
+{
+    if(!matchingThread_.joinable())
+        return;
+    stopping_.store(true, std::memory_order_release);
+    matchingThread_.join();
+}
+
+/* Matching thread */
+void MatchingEngine::Run()
+{
+    PinToCpu();
+
+    std::size_t idle = 0;
+    Command command;
+
+    while(true)
+    {
+        bool worked = false;
+        const std::size_t count = sessionCount_.load(std::memory_order_acquire);
+
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            Session& session = *sessions_[i];
+            // take a bounded batch so one busy session cant starve the others
+            for(std::size_t taken = 0; taken < 64 && session.inbound_.TryPop(command); ++taken)
+            {
+                Process(session, command);
+                worked = true;
+            }
+        }
+
+        if(worked){
+            busyPolls_.Add();
+            idle = 0;
+            continue;
+        }
+        idlePolls_.Add();
+
+        // only stop once every ring is drained
+        if(stopping_.load(std::memory_order_acquire))
+            return;
+
+        if(++idle > IdleSpins)
+            std::this_thread::yield();
+    }
+}
+
+void MatchingEngine::Process(Session& session, const Command& command)
+{
+    commands_.Add();
+
+    ExecutionReport final;
+    final.instrumentId_ = command.instrumentId_;
+    final.orderId_ = command.orderId_;
+
+    auto Finish = [&](){
+        if(final.type_ == ReportType::Rejected)
+            rejects_.Add();
+        Publish(session, final);
+    };
+
+    // the engine owns its books without expiry threads, whoever runs the clock sends these
+    if(command.type_ == CommandType::PruneGoodForDay){
+        for(auto& [_, instrument] : books_)
+            instrument.book_->CancelGoodForDayOrders();
+        Finish();
+        return;
+    }
+    if(command.type_ == CommandType::Expire){
+        for(auto& [_, instrument] : books_)
+            instrument.book_->ExpireOrders(command.time_);
+        Finish();
+        return;
+    }
+
+    auto found = books_.find(command.instrumentId_);
+    if(found == books_.end()){
+        final.type_ = ReportType::Rejected;
+        final.reason_ = RejectReason::UnknownInstrument;
+        Finish();
+        return;
+    }
+
+    Instrument& instrument = found->second;
+    SingleThreadedOrderbook& book = *instrument.book_;
+
+    // remember the busiest instrument so shard imbalance is easy to spot
+    if(++instrument.commands_ > hottestCommands_.Load()){
+        hottestInstrument_.store(command.instrumentId_, std::memory_order_relaxed);
+        hottestCommands_.Set(instrument.commands_);
+    }
+
+    // fills are published from inside the matching loop, no Trades vector in between
+    std::size_t fills = 0;
+    auto PublishTrade = [&](const Trade& trade){
+        ++fills;
+        trades_.Add();
+        ExecutionReport report;
+        report.type_ = ReportType::Trade;
+        report.instrumentId_ = command.instrumentId_;
+        report.orderId_ = command.orderId_;
+        report.bidTrade_ = trade.GetBidTrade();
+        report.askTrade_ = trade.GetAskTrade();
+        Publish(session, report);
+    };
+
+    switch(command.type_)
+    {
+        case CommandType::Add:
+        {
+            // a command is only bytes from a producer, ToOrder would throw on the matching thread
+            if(command.peak_ != 0 && !Order::CanBeIceberg(command.orderType_, command.peak_)){
+                final.type_ = ReportType::Rejected;
+                final.reason_ = RejectReason::InvalidIceberg;
+                break;
+            }
+            // duplicates and risk rejects come back with their reason
+            final.reason_ = book.AddOrder(command.ToOrder(), PublishTrade);
+            if(final.reason_ != RejectReason::None){
+                final.type_ = ReportType::Rejected;
+                break;
+            }
+            // the book drops orders it cannot take (no liquidity for market, FAK, FOK)
+            if(fills == 0 && !book.Contains(command.orderId_)){
+                final.type_ = ReportType::Rejected;
+                final.reason_ = RejectReason::NoLiquidity;
+            }
+            break;
+        }
+        case CommandType::Cancel:
+            if(!book.Contains(command.orderId_)){
+                final.type_ = ReportType::Rejected;
+                final.reason_ = RejectReason::UnknownOrder;
+                break;
+            }
+            book.CancelOrder(command.orderId_);
+            final.type_ = ReportType::Cancelled;
+            break;
+        case CommandType::Modify:
+        {
+            final.reason_ = book.ModifyOrder(command.ToOrderModify(), PublishTrade);
+            if(final.reason_ != RejectReason::None){
+                final.type_ = ReportType::Rejected;
+                break;
+            }
+            // amending down to nothing is how the book cancels, it went and that is what was asked
+            if(command.quantity_ == 0){
+                final.type_ = ReportType::Cancelled;
+                break;
+            }
+            if(fills == 0 && !book.Contains(command.orderId_)){
+                final.type_ = ReportType::Rejected;
+                final.reason_ = RejectReason::NoLiquidity;
+            }
+            break;
+        }
+        case CommandType::AuctionStart:
+        case CommandType::AuctionUncross:
+            book.Apply(command, PublishTrade);
+            break;
+        case CommandType::SetAccountLimits:
+            final.reason_ = book.Apply(command, PublishTrade);
+            if(final.reason_ != RejectReason::None)
+                final.type_ = ReportType::Rejected;
+            break;
+        case CommandType::PruneGoodForDay:
+        case CommandType::Expire:
+            break; // handled above, they are not for one book
+    }
+
+    Finish();
+}
+
+/* reports are never dropped, a full outbound ring holds matching until the producer polls */
+void MatchingEngine::Publish(Session& session, const ExecutionReport& report)
+{
+    while(!session.outbound_.TryPush(report))
+        std::this_thread::yield();
+}
+
+void MatchingEngine::PinToCpu()
+{
+    if(!config_.cpu_.has_value())
+        return;
+
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(*config_.cpu_, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+}
+
+EngineStats MatchingEngine::Stats() const
+{
+    EngineStats stats;
+    stats.instruments_ = instrumentCount_.load(std::memory_order_relaxed);
+    stats.commands_ = commands_.Load();
+    stats.trades_ = trades_.Load();
+    stats.rejects_ = rejects_.Load();
+    stats.busyPolls_ = busyPolls_.Load();
+    stats.idlePolls_ = idlePolls_.Load();
+    stats.hottestInstrument_ = hottestInstrument_.load(std::memory_order_relaxed);
+    stats.hottestCommands_ = hottestCommands_.Load();
+    return stats;
+}
+
+/* Session */
+Trades MatchingEngine::Session::Execute(const Command& command, ExecutionReport& final)
+{
+    while(!inbound_.TryPush(command))
+        std::this_thread::yield();
+
+    Trades trades;
+    ExecutionReport report;
+    while(true)
+    {
+        if(!outbound_.TryPop(report)){
+            std::this_thread::yield();
+            continue;
+        }
+        if(report.IsFinal()){
+            final = report;
+            return trades;
+        }
+        trades.push_back(Trade{report.bidTrade_, report.askTrade_});
+    }
+}
+
+Trades MatchingEngine::Session::AddOrder(const Order& order, InstrumentId instrumentId)
+{
+    ExecutionReport final;
+    return Execute(Command::Add(order, instrumentId), final);
+}
+
+bool MatchingEngine::Session::CancelOrder(OrderId orderId, InstrumentId instrumentId)
+{
+    ExecutionReport final;
+    Execute(Command::Cancel(orderId, instrumentId), final);
+    return final.type_ == ReportType::Cancelled;
+}
+
+Trades MatchingEngine::Session::ModifyOrder(const OrderModify& order, InstrumentId instrumentId)
+{
+    ExecutionReport final;
+    return Execute(Command::Modify(order, instrumentId), final);
+}
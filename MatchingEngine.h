@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include "Command.h"
+#include "ExecutionReport.h"
+#include "Orderbook.h"
+#include "OrderbookConfig.h"
+#include "SpscQueue.h"
+#include "Trade.h"
+
+/* Matching engine */
+/*
+ * one matching thread owns a set of orderbooks (one per instrument), nobody else
+ * touches them while it runs
+ * every producer thread opens its own Session, which is a pair of SPSC rings:
+ * commands go in on one, execution reports come back on the other
+ *
+ * the matching thread polls all sessions round robin, so producers never share
+ * a lock with each other or with matching, and never sleep in the kernel
+ *
+ * the books run without their prune thread, GoodForDay pruning is just another command
+ */
+
+struct MatchingEngineConfig {
+    OrderbookConfig book_{};
+    std::size_t maxSessions_ = 16;
+    std::size_t queueCapacity_ = 1 << 14; // per ring
+    std::optional<int> cpu_;              // pin the matching thread to this core
+};
+
+/* counters of one engine, written only by its matching thread */
+struct EngineStats {
+    std::size_t instruments_{};
+    std::uint64_t commands_{};
+    std::uint64_t trades_{};
+    std::uint64_t rejects_{};
+    std::uint64_t busyPolls_{};  // passes over the sessions that found work
+    std::uint64_t idlePolls_{};  // passes that found nothing
+    InstrumentId hottestInstrument_{};
+    std::uint64_t hottestCommands_{}; // commands seen by the hottest instrument
+};
+
+class MatchingEngine {
+public:
+    /* owned by one producer thread */
+    class Session {
+    public:
+        explicit Session(std::size_t capacity) : inbound_{capacity}, outbound_{capacity} {}
+
+        /* non blocking, reports for it arrive in submission order */
+        bool TrySubmit(const Command& command) {return inbound_.TryPush(command);}
+        bool TryPoll(ExecutionReport& report) {return outbound_.TryPop(report);}
+
+        /* blocking wrappers with the same shape as the Orderbook api
+         * dont mix them with TrySubmit on the same session while reports are outstanding
+         */
+        Trades AddOrder(const Order& order, InstrumentId instrumentId = 0);
+        bool CancelOrder(OrderId orderId, InstrumentId instrumentId = 0);
+        Trades ModifyOrder(const OrderModify& order, InstrumentId instrumentId = 0);
+
+        /* submit and wait for the final report, trades along the way are returned */
+        Trades Execute(const Command& command, ExecutionReport& final);
+
+    private:
+        friend class MatchingEngine;
+
+        SpscQueue<Command> inbound_;
+        SpscQueue<ExecutionReport> outbound_;
+    };
+
+    explicit MatchingEngine(const MatchingEngineConfig& config = {});
+    ~MatchingEngine();
+    MatchingEngine(const MatchingEngine&) = delete;
+    MatchingEngine& operator=(const MatchingEngine&) = delete;
+
+    /* only while stopped, commands for instruments not added here are rejected */
+    void AddInstrument(InstrumentId instrumentId);
+
+    /* safe from any thread, at most maxSessions_ of them */
+    Session& OpenSession();
+
+    void Start();
+    /* drains whatever was submitted, then joins the matching thread */
+    void Stop();
+
+    /* only look at it while the engine is stopped */
+    const SingleThreadedOrderbook& Book(InstrumentId instrumentId = 0) const {return *books_.at(instrumentId).book_;}
+
+    /* safe from any thread, counters are relaxed so they can be slightly behind */
+    EngineStats Stats() const;
+
+private:
+    struct Instrument {
+        // the matching thread is the only one allowed near it, so no locks and no expiry thread
+        std::unique_ptr<SingleThreadedOrderbook> book_;
+        std::uint64_t commands_{};
+    };
+
+    /* single writer counter, readers on other threads only ever load it */
+    struct Counter {
+        std::atomic<std::uint64_t> value_{0};
+        void Add(std::uint64_t count = 1) {value_.store(value_.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);}
+        void Set(std::uint64_t value) {value_.store(value, std::memory_order_relaxed);}
+        std::uint64_t Load() const {return value_.load(std::memory_order_relaxed);}
+    };
+
+    void Run();
+    void Process(Session& session, const Command& command);
+    void Publish(Session& session, const ExecutionReport& report);
+    void PinToCpu();
+
+    MatchingEngineConfig config_;
+    OrderbookConfig bookConfig_;
+    std::unordered_map<InstrumentId, Instrument> books_;
+
+    std::unique_ptr<std::unique_ptr<Session>[]> sessions_;
+    std::atomic<std::size_t> sessionCount_{0};
+    std::mutex sessionsMutex_; // only for opening sessions
+
+    std::thread matchingThread_;
+    std::atomic<bool> stopping_{false};
+
+    std::atomic<std::size_t> instrumentCount_{0};
+    Counter commands_, trades_, rejects_, busyPolls_, idlePolls_;
+    std::atomic<InstrumentId> hottestInstrument_{0};
+    Counter hottestCommands_;
+};
@@ -1,7 +1,6 @@
 #pragma once
 
 
-#include <list>
 #include <exception>
 #include <stdexcept>
 #include <format>
@@ -12,27 +11,83 @@
 #include "Constants.h"
 #include <sstream>
 #include <cmath>
+#include <cstdint>
+#include <algorithm>
 
 /* class to make an order object */
-/* it has public apis to know about the order details */
+/* it has public apis to know about the order details
+ *
+ * packed into 32 bytes, the type and side share a byte as bit fields, what matching reads
+ * (remaining quantity, id, price) comes first, right behind the pool node's next link
+ * (see OrderPool.h for how that lands on cache lines)
+ * the account sits in what would otherwise be padding
+ * only GoodTillTime orders have a deadline, the other types keep an iceberg's peak in its place
+ *
+ * an iceberg shows at most peak of its quantity at a time: its quantity is cut into peak sized
+ * slices in order, the slice being filled is displayed and the rest is hidden, so what is
+ * displayed follows from the peak and what was filled and needs nothing more stored
+ */
 
 class Order {
 public:
     Order(OrderType orderType,OrderId orderId,Side side,Price price,Quantity quantity)
-    : orderType_(orderType), orderId_(orderId), side_(side), price_(price), initialQuantity_(quantity), remainingQuantity_(quantity)
+    : Order(orderType,orderId,side,price,quantity,Timestamp{})
     {}
 
+    // expiry only means something for GoodTillTime orders
+    Order(OrderType orderType,OrderId orderId,Side side,Price price,Quantity quantity,Timestamp expiry,AccountId account = 0)
+    : remainingQuantity_(quantity), price_(price), orderId_(orderId), initialQuantity_(quantity),
+      orderType_(static_cast<std::uint8_t>(orderType)), side_(static_cast<std::uint8_t>(side)), account_(account)
+    {
+        if(orderType == OrderType::GoodTillTime)
+            expiry_ = expiry;
+        else
+            peak_ = 0;
+    }
+
     // market order doesnt care about price just cares about quantity
-    Order(OrderId orderId,Side side,Quantity quantity)
-    : Order(OrderType::Market,orderId,side,Constants::InvalidPrice,quantity)
+    Order(OrderId orderId,Side side,Quantity quantity,AccountId account = 0)
+    : Order(OrderType::Market,orderId,side,Constants::InvalidPrice,quantity,Timestamp{},account)
     {}
 
+    /* an order that shows at most peak at a time and keeps the rest hidden behind it
+     * only GoodTillCancel and GoodForDay orders rest without a deadline of their own
+     */
+    static Order Iceberg(OrderType orderType,OrderId orderId,Side side,Price price,Quantity quantity,Quantity peak,AccountId account = 0){
+        if(!CanBeIceberg(orderType, peak)){
+            std::ostringstream oss;
+            oss << "Order (" << orderId << ") can only be an iceberg as a GoodTillCancel or GoodForDay order with a peak.";
+            throw std::logic_error(oss.str());
+        }
+        Order order{orderType,orderId,side,price,quantity,Timestamp{},account};
+        order.peak_ = peak;
+        return order;
+    }
+
+    static bool CanBeIceberg(OrderType orderType,Quantity peak){
+        return (orderType == OrderType::GoodTillCancel || orderType == OrderType::GoodForDay) && peak != 0;
+    }
+
     OrderId GetOrderId() const {return orderId_;}
-    Side GetSide() const {return side_;}
+    Side GetSide() const {return static_cast<Side>(side_);}
     Price GetPrice() const {return price_;}
-    OrderType GetOrderType() const {return orderType_;}
+    OrderType GetOrderType() const {return static_cast<OrderType>(orderType_);}
     Quantity GetInitialQuantity() const {return initialQuantity_;}
     Quantity GetRemainingQuantity() const {return remainingQuantity_;}
+    Timestamp GetExpiry() const {return GetOrderType() == OrderType::GoodTillTime ? expiry_ : Timestamp{};}
+    /* 0 unless it is an iceberg */
+    Quantity GetPeak() const {return GetOrderType() == OrderType::GoodTillTime ? 0 : peak_;}
+    bool IsIceberg() const {return GetPeak() != 0;}
+    /* what the book shows of it, all of the remaining quantity unless it is an iceberg */
+    Quantity GetDisplayedQuantity() const {
+        const Quantity peak = GetPeak();
+        if(peak == 0)
+            return remainingQuantity_;
+        const std::uint64_t filled = GetFilledQuantity();
+        const std::uint64_t sliceEnd = std::min<std::uint64_t>((filled / peak + 1) * peak, initialQuantity_);
+        return static_cast<Quantity>(sliceEnd - filled);
+    }
+    AccountId GetAccount() const {return account_;}
     Quantity GetFilledQuantity() const {return GetInitialQuantity() - GetRemainingQuantity();}
     bool IsFilled() const {return remainingQuantity_ == 0;}
     /* fill the quantity required in order by qty */
@@ -45,6 +100,23 @@ public:
 
         remainingQuantity_-=quantity;
     }
+    /* amend down in place, what was already filled stays filled */
+    void ReduceTo(Quantity remaining){
+        if(remaining > remainingQuantity_){
+            std::ostringstream oss;
+            oss << "Order (" << GetOrderId() << ") can only be reduced in place.";
+            throw std::logic_error(oss.str());
+        }
+        initialQuantity_ -= remainingQuantity_ - remaining;
+        remainingQuantity_ = remaining;
+    }
+    /* amend that moves the order, it starts over like a new order with the same id, type and deadline (or peak) */
+    void Replace(Side side, Price price, Quantity quantity){
+        side_ = static_cast<std::uint8_t>(side);
+        price_ = price;
+        initialQuantity_ = quantity;
+        remainingQuantity_ = quantity;
+    }
     void ToGoodTillCancel(Price price){
        if(GetOrderType()!=OrderType::Market){
            std::ostringstream oss;
@@ -58,28 +130,30 @@ public:
        //     throw std::logic_error(oss.str());
        // }
         price_ = price;
-        orderType_ = OrderType::GoodTillCancel;
+        orderType_ = static_cast<std::uint8_t>(OrderType::GoodTillCancel);
     }
 
 private:
-    OrderType orderType_;
-    OrderId orderId_;
-    Side side_;
+    Quantity remainingQuantity_;
     Price price_;
+    OrderId orderId_;
     Quantity initialQuantity_;
-    Quantity remainingQuantity_;
+    std::uint8_t orderType_ : 3; // OrderType
+    std::uint8_t side_ : 1;      // Side
+    AccountId account_;
+    union {
+        Timestamp expiry_; // GoodTillTime
+        Quantity peak_;    // every other type
+    };
 };
+static_assert(sizeof(Order) == 32, "resting orders are packed into half a cache line");
 
 
 /* Using shared pointers for better memory management */
 
-/* refrencing our orders using pointers */
-using OrderPointer = std::shared_ptr<Order>;
-/* store order pointer in list .
+/* callers hand orders to the book through this pointer
  *
- * list gives us an iterator that cant be in validated given the list can grow very large
-    list can be dispersed in memory wherease a vector is contiguous in memory
-    I am using a list here for simplicity
+ * the book copies the order into its own pool (see OrderPool.h) so resting orders
+ * never sit behind a shared_ptr control block or a std::list node
  */
-
-using OrderPointers  = std::list<OrderPointer>;
+using OrderPointer = std::shared_ptr<Order>;
@@ -15,7 +15,11 @@ public:
     Price GetPrice() const {return price_;}
     Quantity GetQuantity() const {return quantity_;}
 
-    /* Modify Order and return a new one */
+    /* Modify Order and return a new one, it keeps the type and deadline of the one it replaces */
+    Order ToOrder(OrderType type, Timestamp expiry = {}) const {
+        return Order{type,GetOrderId(),GetSide(),GetPrice(),GetQuantity(),expiry};
+    }
+
     OrderPointer ToOrderPointer(OrderType type) const {
         return std::make_shared<Order>(type,GetOrderId(),GetSide(),GetPrice(),GetQuantity());
     }
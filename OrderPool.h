@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "Order.h"
+
+/* Pooled storage for resting orders */
+/*
+ * every order that rests in the book lives inside a node handed out by this pool
+ * nodes carry intrusive prev/next links so a price level does not need its own list nodes
+ *
+ * the pool grows a whole slab at a time when it runs dry and never gives memory back
+ * released nodes go on a free list, so once the book is warm acquire/release never allocate
+ */
+
+struct OrderNode {
+    OrderNode* next_{nullptr}; // next to the order's hot fields, matching walks both
+    Order order_{OrderType::GoodTillCancel, 0, Side::Buy, 0, 0};
+    OrderNode* prev_{nullptr};
+};
+// not aligned to a cache line, slabs pack nodes back to back so 1 node in 4 has next_ and the
+// order's hot fields split over two lines, padding to 64 measured no faster and costs a third more memory
+static_assert(sizeof(OrderNode) == 48);
+
+class OrderPool {
+public:
+    static constexpr std::size_t DefaultSlabSize = 4096;
+
+    explicit OrderPool(std::size_t slabSize = DefaultSlabSize)
+    : slabSize_{slabSize == 0 ? DefaultSlabSize : slabSize}
+    {}
+    OrderPool(const OrderPool&) = delete;
+    OrderPool& operator=(const OrderPool&) = delete;
+
+    /* take a node off the free list and copy the order into it */
+    OrderNode* Acquire(const Order& order){
+        if(free_ == nullptr)
+            Grow();
+
+        OrderNode* node = free_;
+        free_ = node->next_;
+
+        node->order_ = order;
+        node->prev_ = nullptr;
+        node->next_ = nullptr;
+        ++inUse_;
+        return node;
+    }
+
+    /* node must already be unlinked from its level */
+    void Release(OrderNode* node){
+        node->prev_ = nullptr;
+        node->next_ = free_;
+        free_ = node;
+        --inUse_;
+    }
+
+    /* make sure count orders can rest without touching the allocator */
+    void Reserve(std::size_t count){
+        while(Capacity() < count)
+            Grow();
+    }
+
+    std::size_t Capacity() const {return slabs_.size() * slabSize_;}
+    std::size_t InUse() const {return inUse_;}
+
+private:
+    void Grow(){
+        auto slab = std::make_unique<OrderNode[]>(slabSize_);
+        // thread the slab backwards so nodes are handed out in address order
+        for(std::size_t i = slabSize_; i > 0; --i){
+            slab[i - 1].next_ = free_;
+            free_ = &slab[i - 1];
+        }
+        slabs_.push_back(std::move(slab));
+    }
+
+    std::size_t slabSize_;
+    std::vector<std::unique_ptr<OrderNode[]>> slabs_;
+    OrderNode* free_{nullptr};
+    std::size_t inUse_{0};
+};
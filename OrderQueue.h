@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include "OrderPool.h"
+
+/* FIFO of orders resting at one price level */
+/*
+ * it only links nodes owned by the OrderPool, it never allocates
+ * front is the oldest order so it has time priority when matching
+ * erase is O(1) given the node, which is what OrderEntry keeps for cancels
+ */
+
+class OrderQueue {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Order;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Order*;
+        using reference = Order&;
+
+        Iterator() = default;
+        explicit Iterator(OrderNode* node) : node_{node} {}
+
+        reference operator*() const {return node_->order_;}
+        pointer operator->() const {return &node_->order_;}
+        Iterator& operator++(){ node_ = node_->next_; return *this; }
+        Iterator operator++(int){ Iterator it = *this; node_ = node_->next_; return it; }
+        bool operator==(const Iterator& other) const = default;
+
+    private:
+        OrderNode* node_{nullptr};
+    };
+
+    OrderQueue() = default;
+    OrderQueue(const OrderQueue&) = delete;
+    OrderQueue& operator=(const OrderQueue&) = delete;
+    OrderQueue(OrderQueue&& other) noexcept
+    : head_{other.head_}, tail_{other.tail_}, size_{other.size_}
+    {
+        other.head_ = other.tail_ = nullptr;
+        other.size_ = 0;
+    }
+    OrderQueue& operator=(OrderQueue&& other) noexcept {
+        head_ = other.head_;
+        tail_ = other.tail_;
+        size_ = other.size_;
+        other.head_ = other.tail_ = nullptr;
+        other.size_ = 0;
+        return *this;
+    }
+
+    bool Empty() const {return size_ == 0;}
+    std::size_t Size() const {return size_;}
+    OrderNode* Front() const {return head_;}
+    OrderNode* Back() const {return tail_;}
+
+    void PushBack(OrderNode* node){
+        node->prev_ = tail_;
+        node->next_ = nullptr;
+        if(tail_)
+            tail_->next_ = node;
+        else
+            head_ = node;
+        tail_ = node;
+        ++size_;
+    }
+
+    void PopFront(){
+        Erase(head_);
+    }
+
+    void Erase(OrderNode* node){
+        if(node->prev_)
+            node->prev_->next_ = node->next_;
+        else
+            head_ = node->next_;
+
+        if(node->next_)
+            node->next_->prev_ = node->prev_;
+        else
+            tail_ = node->prev_;
+
+        node->prev_ = node->next_ = nullptr;
+        --size_;
+    }
+
+    Iterator begin() const {return Iterator{head_};}
+    Iterator end() const {return Iterator{};}
+
+private:
+    OrderNode* head_{nullptr};
+    OrderNode* tail_{nullptr};
+    std::size_t size_{0};
+};
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <cstdint>
+
 /* enum for Types of Orders that are supported by the orderbook */
 
-enum class OrderType {
+enum class OrderType : std::uint8_t {
     GoodTillCancel, // keep it till we cancel
     FillAndKill, // Give me as much as i can get then kill my order
     FillOrKill,  // Either fill totally or kill my order
-    GoodForDay, // keep it till we cancel or 4pm whichever is early
+    GoodForDay, // keep it till we cancel or the session closes whichever is early
     Market, // we dont care about price we care about quantity
+    GoodTillTime, // keep it till we cancel or its own deadline, a good till date is this with the deadline on that date
 };
@@ -1,4 +1,6 @@
 #include "Orderbook.h"
+#include "Instrumentation.h"
+#include "Journal.h"
 #include "Order.h"
 #include "OrderType.h"
 #include "Side.h"
@@ -10,391 +12,1134 @@
 #include <numeric>
 #include <chrono>
 #include <ctime>
-#include <optional>
+#include <limits>
+#include <stdexcept>
 
 /* Constructers and more */
 /* when i create an orderbook
- * i start pruning good for day orders thread
+ * i warm up the order pool and the id map so the first orders dont allocate
+ * then i start the expiry thread for good for day / good till time orders (unless whoever owns the book does it
+ * or the policy builds the book without one)
  * I need to pass this to it as thread expects a callable object
  */
-Orderbook::Orderbook() : ordersPruneThread_{[this] {PruneGoodForDayOrders();}}{}
-Orderbook::~Orderbook(){
-    shutdown_.store(true, std::memory_order_release);
-	shutdownConditionVariable_.notify_one();
-	ordersPruneThread_.join();
+template<typename Policy>
+BasicOrderbook<Policy>::BasicOrderbook(const OrderbookConfig& config)
+: bids_{config.ladderLevels_, config.tickSize_, config.basePrice_},
+  asks_{config.ladderLevels_, config.tickSize_, config.basePrice_},
+  expiryBatch_{config.expiryBatch_},
+  sessionClose_{config.sessionClose_},
+  publishLevelUpdates_{config.levelUpdates_},
+  risk_{config.risk_},
+  publishDepth_{config.depthSnapshots_}
+{
+    pool_.Reserve(config.orderCapacity_);
+    orders_.reserve(config.orderCapacity_);
+    expiring_.reserve(expiryBatch_);
+    if constexpr(Policy::ExpiryThread)
+        if(config.pruneThread_)
+            ordersPruneThread_ = std::thread{[this] {ExpireOrdersThread();}};
+}
+template<typename Policy>
+BasicOrderbook<Policy>::~BasicOrderbook(){
+    {
+        // under the lock so the thread cannot miss it between checking and going to sleep
+        std::scoped_lock ordersLock{ordersMutex_};
+        shutdown_.store(true, std::memory_order_release);
+    }
+	expiryConditionVariable_.notify_one();
+	if(ordersPruneThread_.joinable())
+		ordersPruneThread_.join();
 }
 
 
 /* Private functions */
-void Orderbook::PruneGoodForDayOrders()
-{
-    using namespace std::chrono;
+namespace {
 
-    const auto end = hours(16); // 4 PM
+using SystemClock = std::chrono::system_clock;
 
-    while (true)
-    {
-        const auto now = system_clock::now();
-        const auto now_c = system_clock::to_time_t(now);
-        std::tm now_parts;
+/* next time the local clock reads close, today if it has not passed yet */
+SystemClock::time_point NextSessionClose(SystemClock::time_point now, std::chrono::seconds close)
+{
+    const auto now_c = SystemClock::to_time_t(now);
+    std::tm now_parts;
 
-        //  Use thread-safe & portable time function
+    //  Use thread-safe & portable time function
 #if defined(_WIN32) || defined(_WIN64)
-        localtime_s(&now_parts, &now_c);  // Windows
+    localtime_s(&now_parts, &now_c);  // Windows
 #else
-        localtime_r(&now_c, &now_parts);  // Linux/macOS
+    localtime_r(&now_c, &now_parts);  // Linux/macOS
 #endif
 
-        // Move to next day if it's already past 4 PM
-        if (now_parts.tm_hour >= end.count())
-            now_parts.tm_mday += 1;
+    const auto sinceMidnight = std::chrono::hours(now_parts.tm_hour) + std::chrono::minutes(now_parts.tm_min)
+                             + std::chrono::seconds(now_parts.tm_sec);
+    // Move to next day if the close has already passed
+    if (sinceMidnight >= close)
+        now_parts.tm_mday += 1;
+
+    // mktime normalises the seconds into hours and minutes
+    now_parts.tm_hour = 0;
+    now_parts.tm_min = 0;
+    now_parts.tm_sec = static_cast<int>(close.count());
+    now_parts.tm_isdst = -1;
+    return SystemClock::from_time_t(mktime(&now_parts));
+}
+
+Timestamp ToTimestamp(SystemClock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+SystemClock::time_point FromTimestamp(Timestamp timestamp)
+{
+    return SystemClock::time_point{std::chrono::duration_cast<SystemClock::duration>(std::chrono::nanoseconds{timestamp})};
+}
+
+}
 
-        // Set exact 4:00:00 PM time
-        now_parts.tm_hour = end.count();
-        now_parts.tm_min = 0;
-        now_parts.tm_sec = 0;
+/* sleeps until the close or the earliest deadline, whichever is first
+ * a GoodTillTime order with an earlier deadline wakes it up to sleep less
+ */
+template<typename Policy>
+void BasicOrderbook<Policy>::ExpireOrdersThread()
+{
+    using namespace std::chrono;
 
-        auto next = system_clock::from_time_t(mktime(&now_parts));
-        auto till = next - now + milliseconds(100);
+    auto close = NextSessionClose(SystemClock::now(), sessionClose_);
 
+    while (true)
+    {
         {
             std::unique_lock ordersLock{ ordersMutex_ };
 
+            auto until = close + milliseconds(100);
+            const Timestamp deadline = expiries_.NextDeadline();
+            if (deadline < ToTimestamp(until))
+                until = FromTimestamp(deadline);
+
             // Explicit check for shutdown using wait predicate
-            if (shutdownConditionVariable_.wait_for(
-                    ordersLock, till, [this]() { return shutdown_.load(std::memory_order_acquire); }))
-            {
+            expiryConditionVariable_.wait_until(ordersLock, until,
+                [this]() { return shutdown_.load(std::memory_order_acquire) || wakeExpiry_; });
+            if (shutdown_.load(std::memory_order_acquire))
                 return; // shutdown requested
+            if (wakeExpiry_)
+            {
+                wakeExpiry_ = false;
+                continue; // work out how long to sleep again
             }
         }
 
-        // Now prune GoodForDay orders
-        OrderIds orderIds;
-
+        const auto now = SystemClock::now();
+        if (now >= close)
         {
-            std::scoped_lock ordersLock{ ordersMutex_ };
+            PruneGoodForDay(true);
+            close = NextSessionClose(now, sessionClose_);
+        }
+        ExpireOrders(ToTimestamp(now));
+    }
+}
 
-            for (const auto& [_, entry] : orders_)
-            {
-                const auto& [order, __] = entry;
+template<typename Policy>
+void BasicOrderbook<Policy>::CancelGoodForDayOrders()
+{
+    PruneGoodForDay(false);
+}
 
-                if (order->GetOrderType() == OrderType::GoodForDay)
-                {
-                    orderIds.push_back(order->GetOrderId());
-                }
-            }
-        }
+/* unlessAuction: at the close a closing auction still running keeps them, its uncross takes them */
+template<typename Policy>
+void BasicOrderbook<Policy>::PruneGoodForDay(bool unlessAuction)
+{
+    std::size_t expired;
+    do
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        if (unlessAuction && auction_)
+            return;
+        expired = PruneGoodForDayBatch(expiryBatch_);
+        PublishMarketData();
+    }
+    while (expiryBatch_ != 0 && expired == expiryBatch_);
+}
 
-        CancelOrders(orderIds);
+template<typename Policy>
+std::size_t BasicOrderbook<Policy>::ExpireOrders(Timestamp now)
+{
+    std::size_t total = 0, expired;
+    do
+    {
+        std::scoped_lock ordersLock{ ordersMutex_ };
+        expired = ExpireBatch(now, expiryBatch_);
+        total += expired;
+        PublishMarketData();
     }
+    while (expiryBatch_ != 0 && expired == expiryBatch_);
+    return total;
+}
+
+/* lock held, one batch journaled as that batch so a replay expires exactly the same orders
+ * the index only hands out orders that expire, nothing scans the book
+ */
+template<typename Policy>
+std::size_t BasicOrderbook<Policy>::PruneGoodForDayBatch(std::size_t maxOrders)
+{
+    expiring_.clear();
+    expiries_.DueAtClose(maxOrders == 0 ? std::numeric_limits<std::size_t>::max() : maxOrders, expiring_);
+    if (expiring_.empty())
+        return 0;
+
+    Journal(Command::PruneGoodForDay(static_cast<Quantity>(maxOrders)));
+    for (const auto& orderId : expiring_)
+        CancelOrderInternal(orderId);
+    return expiring_.size();
+}
+
+template<typename Policy>
+std::size_t BasicOrderbook<Policy>::ExpireBatch(Timestamp now, std::size_t maxOrders)
+{
+    expiring_.clear();
+    expiries_.Due(now, maxOrders == 0 ? std::numeric_limits<std::size_t>::max() : maxOrders, expiring_);
+    if (expiring_.empty())
+        return 0;
+
+    Journal(Command::Expire(now, static_cast<Quantity>(maxOrders)));
+    for (const auto& orderId : expiring_)
+        CancelOrderInternal(orderId);
+    return expiring_.size();
+}
+
+template<typename Policy>
+bool BasicOrderbook<Policy>::Contains(OrderId orderId) const
+{
+    std::scoped_lock ordersLock{ordersMutex_};
+    return orders_.contains(orderId);
+}
+
+template<typename Policy>
+void BasicOrderbook<Policy>::AttachJournal(JournalWriter* journal)
+{
+    std::scoped_lock ordersLock{ordersMutex_};
+    journal_ = journal;
+}
+
+/* called with the lock held, so records land in the order the book applied them */
+template<typename Policy>
+void BasicOrderbook<Policy>::Journal(const Command& command)
+{
+    if(journal_ != nullptr)
+        journal_->Append(command);
 }
 
 /* to cancel the order */
-void Orderbook::CancelOrder(OrderId orderId)
+template<typename Policy>
+void BasicOrderbook<Policy>::CancelOrder(OrderId orderId)
 {
     std::scoped_lock ordersLock{ordersMutex_};
-    CancelOrderInternal(orderId);
+    CancelOrderJournaled(orderId);
+    PublishMarketData();
 }
 
-void Orderbook::CancelOrders(OrderIds orderIds){
+template<typename Policy>
+void BasicOrderbook<Policy>::CancelOrders(OrderIds orderIds){
     std::scoped_lock orderLock {ordersMutex_};
 
-    for(const auto & orderId : orderIds){
-        CancelOrderInternal(orderId);
-    }
+    for(const auto & orderId : orderIds)
+        CancelOrderJournaled(orderId);
+    PublishMarketData();
+}
+
+/* lock held, a cancel that came in from outside, journaled only if the order is there */
+template<typename Policy>
+bool BasicOrderbook<Policy>::CancelOrderJournaled(OrderId orderId){
+    if(!orders_.contains(orderId)) return false;
+
+    Journal(Command::Cancel(orderId));
+    CancelOrderInternal(orderId);
+    return true;
 }
 /* i am not deleting the orders one by one as it would have to lock mutes an realease multiple times
  * causing multiple cache flushed . this is not good for cache coherence
  */
-void Orderbook::CancelOrderInternal(OrderId orderId){
-    if(!orders_.contains(orderId)) return;
-
-    const auto [order,iterator] =orders_[orderId];
-    orders_.erase(orderId);
+template<typename Policy>
+void BasicOrderbook<Policy>::CancelOrderInternal(OrderId orderId){
+    auto entry = orders_.find(orderId);
+    if(entry == orders_.end()) return;
+
+    OrderNode* node = entry->second.node_;
+    expiries_.Cancel(entry->second.expiry_);
+    orders_.erase(entry);
+
+    if(risk_.Enabled())
+        risk_.OnReleased(node->order_, node->order_.GetRemainingQuantity());
+    UnlinkOrder(node);
+	pool_.Release(node);
+}
 
-    if (order->GetSide() == Side::Sell)
+/* take a resting order off its level, the node itself stays with the caller */
+template<typename Policy>
+void BasicOrderbook<Policy>::UnlinkOrder(OrderNode* node){
+    const Order& order = node->order_;
+    if (order.GetSide() == Side::Sell)
 	{
-		auto price = order->GetPrice();
-		auto& orders = asks_.at(price);
-		orders.erase(iterator);
-		if (orders.empty())
-			asks_.erase(price);
+		auto price = order.GetPrice();
+		auto& orders = asks_.At(price);
+		orders.Erase(node);
+		OnOrderCancelled(order); // level data lives with the level, update it before the level can go
+		if (orders.Empty())
+			asks_.Erase(price);
 	}
 	else
 	{
-		auto price = order->GetPrice();
-		auto& orders = bids_.at(price);
-		orders.erase(iterator);
-		if (orders.empty())
-			bids_.erase(price);
+		auto price = order.GetPrice();
+		auto& orders = bids_.At(price);
+		orders.Erase(node);
+		OnOrderCancelled(order);
+		if (orders.Empty())
+			bids_.Erase(price);
 	}
+}
 
-	OnOrderCancelled(order);
+/* put an order at the back of the level for its side and price */
+template<typename Policy>
+void BasicOrderbook<Policy>::LinkOrder(OrderNode* node){
+    const Order& order = node->order_;
+    if(order.GetSide()==Side::Buy)
+        bids_.GetOrCreate(order.GetPrice()).PushBack(node);
+    else
+        asks_.GetOrCreate(order.GetPrice()).PushBack(node);
+}
+
+/* GoodForDay orders wait for the close, GoodTillTime orders for their own deadline */
+template<typename Policy>
+ExpiryIndex::Handle BasicOrderbook<Policy>::ScheduleExpiry(const Order& order){
+    if(order.GetOrderType()==OrderType::GoodForDay)
+        return expiries_.Schedule(ExpiryIndex::EndOfSession, order.GetOrderId());
+    if(order.GetOrderType()!=OrderType::GoodTillTime)
+        return expiries_.None();
+
+    if constexpr(Policy::ExpiryThread){
+        if(order.GetExpiry() < expiries_.NextDeadline()){
+            wakeExpiry_ = true; // the expiry thread is sleeping past this one
+            expiryConditionVariable_.notify_one();
+        }
+    }
+    return expiries_.Schedule(order.GetExpiry(), order.GetOrderId());
+}
+
+/* filled orders leave the id map and, if they could expire, the expiry index */
+template<typename Policy>
+void BasicOrderbook<Policy>::EraseOrderEntry(OrderId orderId){
+    auto entry = orders_.find(orderId);
+    expiries_.Cancel(entry->second.expiry_);
+    orders_.erase(entry);
 }
 
 /* for fill and kill type see if it can match  */
-bool Orderbook::CanMatch(Side side,Price price) const
+template<typename Policy>
+bool BasicOrderbook<Policy>::CanMatch(Side side,Price price) const
 {
     if(side==Side::Buy){
-        if(asks_.empty()) return false;
+        if(asks_.Empty()) return false;
 
         // check if someone is selling at some price that is <= our bid
-        const auto& [bestAsk,_] = *asks_.begin(); // lowest some one is asking for
+        const Price bestAsk = asks_.BestPrice(); // lowest some one is asking for
         return price>=bestAsk; // someone is willing to sell at or below my bid
    }else{
-        if(bids_.empty()) return false;
+        if(bids_.Empty()) return false;
 
         // check if someone is buying at some price that is >= our ask
-        const auto& [bestBid,_] = *bids_.begin(); // highest some one is bidding for
+        const Price bestBid = bids_.BestPrice(); // highest some one is bidding for
         return price<=bestBid; // some is willing to buy atleast at my ask
     }
 }
 
 
-bool Orderbook::CanFullyFill(Side side,Price price,Quantity quantity) const {
+template<typename Policy>
+bool BasicOrderbook<Policy>::CanFullyFill(Side side,Price price,Quantity quantity) const {
     // if i cant even find a match for it
     if(!CanMatch(side, price))
         return false;
 
     // i can find a match for it
     // but can it get fully filled
-    std::optional<Price> threshold;
-
-    if(side==Side::Buy){
-        const auto [askPrice, _ ]  = *asks_.begin();
-        threshold = askPrice;
-    }else{
-        const auto [bidPrice, _ ]  = *bids_.begin();
-        threshold = bidPrice;
-    }
-
-    // we just want to know how much quanity is there between best askPrice and our price  (askPrice<price)
-    // if there is enought its good for us
-
-    for(const auto& [levelPrice,levelData] : data_){
-        if(threshold.has_value() &&
-            (side==Side::Buy && threshold.value() > levelPrice) ||
-            (side==Side::Sell && threshold.value() <levelPrice))
-            continue;
-
-        if((side==Side::Buy && levelPrice > price) || (side==Side::Sell && levelPrice < price))
-            continue;
-
-        if(quantity<=levelData.quantity_)
-            return true;
-        quantity-=levelData.quantity_;
-    }
-
-    return false;
+    // we just want to know how much quanity is on the other side at our price or better
+    // each ladder keeps ordered cumulative depth so this is a prefix sum, not a walk over levels
+    if(side==Side::Buy)
+        return asks_.HasDepth(price, quantity);
+    return bids_.HasDepth(price, quantity);
 }
 
 
-/* match orders and return them */
-Trades Orderbook::MatchOrders(){
-    Trades trades;
-    trades.reserve(orders_.size());// may be all orders can match
+/* match orders, every fill goes straight to the sink */
+template<typename Policy>
+void BasicOrderbook<Policy>::MatchOrders(TradeSink trades){
 
     while(true){
-        if(bids_.empty() || asks_.empty()) break;
+        if(bids_.Empty() || asks_.Empty()) break;
 
-        auto &[bidPrice,bids] = *bids_.begin();
-        auto &[askPrice,asks] = *asks_.begin();
+        const Price bidPrice = bids_.BestPrice();
+        const Price askPrice = asks_.BestPrice();
+        auto& bids = bids_.BestLevel();
+        auto& asks = asks_.BestLevel();
 
         if(bidPrice<askPrice) break;
 
-        while(bids.size() && asks.size()){
-            auto& bid = bids.front();
-            auto& ask = asks.front();
+        while(!bids.Empty() && !asks.Empty()){
+            OrderNode* bidNode = bids.Front();
+            OrderNode* askNode = asks.Front();
+            Order& bid = bidNode->order_;
+            Order& ask = askNode->order_;
+
+            // icebergs trade what they show, the rest of them waits for the next peak
+            const Quantity bidShown = bid.GetDisplayedQuantity();
+            const Quantity askShown = ask.GetDisplayedQuantity();
+            Quantity quantity = std::min(bidShown,askShown);
+
+            bid.Fill(quantity);
+            ask.Fill(quantity);
+            if(risk_.Enabled()){
+                risk_.OnFill(bid, quantity);
+                risk_.OnFill(ask, quantity);
+            }
 
-            Quantity quantity = std::min(bid->GetRemainingQuantity(),ask->GetRemainingQuantity());
+            trades(Trade{
+                TradeInfo{bid.GetOrderId(),bid.GetPrice(),quantity}
+               ,TradeInfo{ask.GetOrderId(),ask.GetPrice(),quantity}
+            });
 
-            bid->Fill(quantity);
-            ask->Fill(quantity);
+            OnOrderMatched(Side::Buy,bid.GetPrice(),quantity,bid.IsFilled());
+            OnOrderMatched(Side::Sell,ask.GetPrice(),quantity,ask.IsFilled());
 
-            if(bid->IsFilled()){
-                bids.pop_front();
-                orders_.erase(bid->GetOrderId());
+            // filled orders go back to the pool, dont touch them after this
+            if(bid.IsFilled()){
+                bids.PopFront();
+                EraseOrderEntry(bid.GetOrderId());
+                pool_.Release(bidNode);
             }
+            else if(quantity == bidShown)
+                Replenish(bids, bidNode);
 
-            if(ask->IsFilled()){
-                asks.pop_front();
-                orders_.erase(ask->GetOrderId());
+            if(ask.IsFilled()){
+                asks.PopFront();
+                EraseOrderEntry(ask.GetOrderId());
+                pool_.Release(askNode);
             }
-
-            trades.push_back(Trade{
-                TradeInfo{bid->GetOrderId(),bid->GetPrice(),quantity}
-               ,TradeInfo{ask->GetOrderId(),ask->GetPrice(),quantity}
-            });
-
-            OnOrderMatched(bid->GetPrice(),quantity,bid->IsFilled());
-            OnOrderMatched(ask->GetPrice(),quantity,ask->IsFilled());
+            else if(quantity == askShown)
+                Replenish(asks, askNode);
         }
 
-        if(bids.empty())
-        {
-            bids_.erase(bidPrice);
-            data_.erase(bidPrice);
-        }
-        if(asks.empty())
-        {
-            asks_.erase(askPrice);
-            data_.erase(askPrice);
-        }
+        if(bids.Empty())
+            bids_.Erase(bidPrice);
+        if(asks.Empty())
+            asks_.Erase(askPrice);
     }
+}
 
+/* lock held, a fill took all an iceberg showed but it has more: it shows the next peak and goes to
+ * the back of its level, behind everything that was there, as a new order of that size would
+ * only icebergs can be left with quantity after a fill that took all they showed
+ */
+template<typename Policy>
+void BasicOrderbook<Policy>::Replenish(OrderQueue& level, OrderNode* node){
+    const Order& order = node->order_;
+    level.Erase(node);
+    level.PushBack(node);
+    UpdateLevelData(order.GetSide(), order.GetPrice(), order.GetDisplayedQuantity(), LevelData::Action::REFRESH);
+}
 
 
-    if(!bids_.empty()){
-        auto& [_,bids] = *bids_.begin();
-        auto& order = bids.front();
-        if(order->GetOrderType()==OrderType::FillAndKill){
-            CancelOrder(order->GetOrderId());
-        }
+
+/* lock held, Market / FillAndKill / FillOrKill orders take what they can straight off the other side
+ * the aggressor never goes into a level, the id index or the pool, whatever is left just goes away
+ * it is reported at its limit, a market order at the worst price on the other side, the same
+ * trades a limit order there would have made
+ */
+template<typename Policy>
+void BasicOrderbook<Policy>::SweepOrder(const Order& order, TradeSink trades)
+{
+    const Side side = order.GetSide();
+    Price limit = order.GetPrice();
+    bool admitted;
+    if(order.GetOrderType()==OrderType::Market){
+        admitted = side==Side::Buy ? !asks_.Empty() : !bids_.Empty();
+        if(admitted)
+            limit = side==Side::Buy ? asks_.WorstPrice() : bids_.WorstPrice();
     }
+    else if(order.GetOrderType()==OrderType::FillOrKill){
+        admitted = CanFullyFill(side, limit, order.GetInitialQuantity());
+    }
+    else{
+        admitted = CanMatch(side, limit);
+    }
+    Instrumentation::Mark(HotPathStage::Admission);
+    if(!admitted)
+        return;
+
+    Quantity remaining = order.GetInitialQuantity();
+    auto Sweep = [&](auto& levels, Side restingSide){
+        while(remaining > 0 && !levels.Empty()){
+            const Price price = levels.BestPrice();
+            if(side==Side::Buy ? price > limit : price < limit)
+                break;
+
+            auto& level = levels.BestLevel();
+            while(remaining > 0 && !level.Empty()){
+                OrderNode* node = level.Front();
+                Order& resting = node->order_;
+                const Quantity shown = resting.GetDisplayedQuantity();
+                const Quantity quantity = std::min(remaining, shown);
+                remaining -= quantity;
+                resting.Fill(quantity);
+                if(risk_.Enabled()){
+                    risk_.OnFill(resting, quantity);
+                    risk_.OnFill(order, quantity);
+                }
 
-    if(!asks_.empty()){
-        auto& [_,asks] = *asks_.begin();
-        auto& order = asks.front();
-        if(order->GetOrderType()==OrderType::FillAndKill){
-            CancelOrder(order->GetOrderId());
+                const TradeInfo aggressor{order.GetOrderId(), limit, quantity};
+                const TradeInfo passive{resting.GetOrderId(), price, quantity};
+                trades(side==Side::Buy ? Trade{aggressor, passive} : Trade{passive, aggressor});
+                // aggressor first, so the last traded price (the band's reference) ends at the resting price it executed at
+                OnTrade(limit, quantity);
+                OnOrderMatched(restingSide, price, quantity, resting.IsFilled());
+
+                // filled orders go back to the pool, dont touch them after this
+                if(resting.IsFilled()){
+                    level.PopFront();
+                    EraseOrderEntry(resting.GetOrderId());
+                    pool_.Release(node);
+                }
+                else if(quantity == shown)
+                    Replenish(level, node);
+            }
+            if(level.Empty())
+                levels.Erase(price);
         }
-    }
-    return trades;
+    };
+    if(side==Side::Buy)
+        Sweep(asks_, Side::Sell);
+    else
+        Sweep(bids_, Side::Buy);
+    Instrumentation::Mark(HotPathStage::Match);
 }
 
+/*Public functions */
+template<typename Policy>
+Trades BasicOrderbook<Policy>::AddOrder(OrderPointer order)
+{
+    return AddOrder(*order);
+}
 
+template<typename Policy>
+Trades BasicOrderbook<Policy>::AddOrder(const Order& order)
+{
+    Trades trades;
+    AddOrder(order, trades);
+    return trades;
+}
 
-/*Public functions */
-Trades Orderbook::AddOrder(OrderPointer order)
+template<typename Policy>
+RejectReason BasicOrderbook<Policy>::AddOrder(const Order& order, TradeSink trades)
 {
+    Instrumentation::Begin();
     std::scoped_lock ordersLock {ordersMutex_};
-    if(orders_.find(order->GetOrderId()) != orders_.end()) // we already have this order
-        return Trades{};
+    const RejectReason reason = AddOrderInternal(order, trades);
+    PublishMarketData();
+    return reason;
+}
 
-    if(order->GetOrderType()==OrderType::Market)
-    {
-        if(order->GetSide()==Side::Buy && !asks_.empty()){
-            const auto& [worstAsk,_] = *asks_.rbegin(); // max sell price
-            order->ToGoodTillCancel(worstAsk);
-        }
-        else if(order->GetSide()==Side::Sell && !bids_.empty()){
-            const auto &[worstBid,_] = *bids_.rbegin(); // min buy price
-            order->ToGoodTillCancel(worstBid);
-        }
-        else{
-            return Trades{};
+template<typename Policy>
+Trades BasicOrderbook<Policy>::Apply(const Command& command)
+{
+    Trades trades;
+    Apply(command, trades);
+    return trades;
+}
+
+template<typename Policy>
+RejectReason BasicOrderbook<Policy>::Apply(const Command& command, TradeSink trades)
+{
+    Instrumentation::Begin();
+    std::scoped_lock ordersLock{ordersMutex_};
+    const RejectReason reason = ApplyInternal(command, trades);
+    PublishMarketData();
+    return reason;
+}
+
+template<typename Policy>
+Trades BasicOrderbook<Policy>::ApplyBatch(std::span<const Command> commands)
+{
+    Trades trades;
+    ApplyBatch(commands, trades);
+    return trades;
+}
+
+/* the same as Apply one by one, in order, but the book is locked once for all of them */
+template<typename Policy>
+void BasicOrderbook<Policy>::ApplyBatch(std::span<const Command> commands, TradeSink trades, std::span<CommandResult> results)
+{
+    if(!results.empty() && results.size() < commands.size())
+        throw std::invalid_argument("ApplyBatch needs a result for every command");
+
+    std::scoped_lock ordersLock{ordersMutex_};
+    for(std::size_t i = 0; i < commands.size(); ++i){
+        Instrumentation::Begin();
+        if(results.empty()){
+            ApplyInternal(commands[i], trades);
+            continue;
         }
+        std::uint32_t fills = 0;
+        auto Counted = [&fills, trades](const Trade& trade){
+            ++fills;
+            trades(trade);
+        };
+        results[i].reason_ = ApplyInternal(commands[i], Counted);
+        results[i].fills_ = fills;
     }
+    PublishMarketData(); // readers see the book between batches, not inside one
+}
 
+/* lock held */
+template<typename Policy>
+RejectReason BasicOrderbook<Policy>::ApplyInternal(const Command& command, TradeSink trades)
+{
+    switch(command.type_){
+        case CommandType::Add:
+            // ToOrder throws on such a peak, which would leave the rest of a batch unapplied
+            if(command.peak_ != 0 && !Order::CanBeIceberg(command.orderType_, command.peak_))
+                return RejectReason::InvalidIceberg;
+            return AddOrderInternal(command.ToOrder(), trades);
+        case CommandType::Cancel:
+            return CancelOrderJournaled(command.orderId_) ? RejectReason::None : RejectReason::UnknownOrder;
+        case CommandType::Modify:
+            return ModifyOrderInternal(command.ToOrderModify(), trades);
+        // a single batch, journal records are one batch each
+        case CommandType::PruneGoodForDay: PruneGoodForDayBatch(command.quantity_); break;
+        case CommandType::Expire: ExpireBatch(command.time_, command.quantity_); break;
+        case CommandType::AuctionStart: StartAuctionInternal(); break;
+        case CommandType::AuctionUncross: UncrossInternal(trades); break;
+        case CommandType::SetAccountLimits:
+            if(!risk_.Enabled() || !risk_.Known(command.account_))
+                return RejectReason::UnknownAccount;
+            risk_.SetLimits(command.account_, command.ToAccountLimits());
+            Journal(command);
+            break;
+    }
+    return RejectReason::None;
+}
 
-    if(order->GetOrderType()==OrderType::FillAndKill && !CanMatch(order->GetSide(),order->GetPrice()) )
-        return Trades{};
-
-    if(order->GetOrderType()==OrderType::FillOrKill && !CanFullyFill(order->GetSide(), order->GetPrice(),order->GetInitialQuantity()))
-        return Trades{};
+/* lock held, duplicates and orders the risk checks turn away are dropped before the journal sees them */
+template<typename Policy>
+RejectReason BasicOrderbook<Policy>::AddOrderInternal(const Order& incoming, TradeSink trades)
+{
+    Instrumentation::Mark(HotPathStage::Lock);
+    if(orders_.contains(incoming.GetOrderId())) // we already have this order
+        return RejectReason::DuplicateOrderId;
+    const OrderType type = incoming.GetOrderType();
+    const bool sweeps = type==OrderType::Market || type==OrderType::FillAndKill || type==OrderType::FillOrKill;
+    if(sweeps && auction_) // nothing to take them against until the uncross
+        return RejectReason::AuctionPhase;
+    if(risk_.Enabled()){
+        const RejectReason reason = risk_.Check(incoming, RiskReference(incoming.GetSide()));
+        if(reason != RejectReason::None)
+            return reason;
+    }
 
-    OrderPointers::iterator iterator;
-    if(order->GetSide()==Side::Buy){
-        auto & orders = bids_[order->GetPrice()]; // get orders of same price
-        orders.push_back(order);
+    // journaled as it came in, replay goes through the same checks and ends up in the same place
+    Journal(Command::Add(incoming));
+    Instrumentation::Mark(HotPathStage::Journal);
 
-        if (orders.empty()) {
-            throw std::runtime_error("Logic error: orders list is unexpectedly empty after push_back.");
-        }
-        iterator =std::next(orders.begin(),orders.size()-1); // iterator to last element in list
-        // iterator = std::prev(orders.end());
-    }else{
-        // sell
-        auto & orders = asks_[order->GetPrice()]; // get orders of same price
-        orders.push_back(order);
-
-        if (orders.empty()) {
-            throw std::runtime_error("Logic error: orders list is unexpectedly empty after push_back.");
-        }
-        iterator = std::prev(orders.end());
+    if(sweeps){
+        SweepOrder(incoming, trades); // these never rest
+        return RejectReason::None;
     }
+    const Order& order = incoming;
+    if(risk_.Enabled())
+        risk_.OnAccepted(order); // before matching, its fills take it off again
+    Instrumentation::Mark(HotPathStage::Admission);
+
+    // copy it into a pooled node and put it at the back of its level
+    OrderNode* node = pool_.Acquire(order);
+    LinkOrder(node);
+
     // we have added that order is asks_ or bids_
     // now add in orders_
-    // id, OrderEntry
-    // so like to get that order from id we store order id mapped to which list in map and iterator in that map
-   orders_.insert({order->GetOrderId(),OrderEntry{order,iterator}});
-   // match it and return trades
+    // id -> node, the node knows its neighbours in the level so cancel is O(1)
+   // orders that can expire are scheduled before matching, a fill unschedules them again
+   orders_.emplace(order.GetOrderId(),OrderEntry{node, ScheduleExpiry(order)});
+   Instrumentation::Mark(HotPathStage::Insert);
+   // match it, fills go to the sink
    OnOrderAdded(order);
-   return MatchOrders();
+   Instrumentation::Mark(HotPathStage::LevelUpdate);
+   if(!auction_)
+       MatchOrders(trades);
+   Instrumentation::Mark(HotPathStage::Match);
+   return RejectReason::None;
+}
+
+/* what the price band is measured from: the last trade, before the first one the best price
+ * on the other side, then on the order's own side, and no band on an empty book
+ */
+template<typename Policy>
+Price BasicOrderbook<Policy>::RiskReference(Side side) const
+{
+    if(totalVolumeTraded_ > 0)
+        return lastTradedPrice_;
+    if(!asks_.Empty() && (side==Side::Buy || bids_.Empty()))
+        return asks_.BestPrice();
+    if(!bids_.Empty())
+        return bids_.BestPrice();
+    return PreTradeRisk::InvalidReference;
+}
+
+template<typename Policy>
+void BasicOrderbook<Policy>::SetAccountLimits(AccountId account, const AccountLimits& limits)
+{
+    std::scoped_lock ordersLock{ordersMutex_};
+    risk_.SetLimits(account, limits);
+    Journal(Command::SetAccountLimits(account, limits)); // only once it took, replay must not throw on it
+}
+
+template<typename Policy>
+AccountRisk BasicOrderbook<Policy>::GetAccountRisk(AccountId account) const
+{
+    std::scoped_lock ordersLock{ordersMutex_};
+    return risk_.Risk(account);
+}
+
+/* Call auction */
+template<typename Policy>
+void BasicOrderbook<Policy>::StartAuction()
+{
+    std::scoped_lock ordersLock{ordersMutex_};
+    StartAuctionInternal();
+    PublishMarketData();
+}
+
+template<typename Policy>
+AuctionResult BasicOrderbook<Policy>::Uncross(TradeSink trades, bool closeSession)
+{
+    std::scoped_lock ordersLock{ordersMutex_};
+    const AuctionResult result = UncrossInternal(trades);
+    if(closeSession)
+        PruneGoodForDayBatch(0);
+    PublishMarketData();
+    return result;
+}
+
+template<typename Policy>
+bool BasicOrderbook<Policy>::InAuction() const
+{
+    std::scoped_lock ordersLock{ordersMutex_};
+    return auction_;
+}
+
+template<typename Policy>
+AuctionResult BasicOrderbook<Policy>::GetIndicativeUncross() const
+{
+    std::scoped_lock ordersLock{ordersMutex_};
+    return indicative_;
+}
+
+/* lock held */
+template<typename Policy>
+void BasicOrderbook<Policy>::StartAuctionInternal()
+{
+    if(auction_) return;
+    Journal(Command::AuctionStart());
+    auction_ = true;
+    indicative_ = {}; // continuous matching left nothing that crosses
+}
+
+/* lock held, trades every bid at or above the equilibrium price against every ask at or below it,
+ * best price first and in time priority within a level, all at the one price
+ * a price that executes the most leaves nothing that still crosses, so continuous matching
+ * picks up an uncrossed book
+ */
+template<typename Policy>
+AuctionResult BasicOrderbook<Policy>::UncrossInternal(TradeSink trades)
+{
+    if(!auction_) return {};
+    Journal(Command::AuctionUncross());
+    const AuctionResult result = ComputeEquilibrium();
+    auction_ = false;
+    indicativeChanged_ = false;
+    indicative_ = {};
+    if(result.volume_ == 0) return result;
+
+    const Price price = result.price_;
+    while(!bids_.Empty() && !asks_.Empty()){
+        const Price bidPrice = bids_.BestPrice();
+        const Price askPrice = asks_.BestPrice();
+        if(bidPrice < price || askPrice > price) break;
+        auto& bids = bids_.BestLevel();
+        auto& asks = asks_.BestLevel();
+
+        while(!bids.Empty() && !asks.Empty()){
+            OrderNode* bidNode = bids.Front();
+            OrderNode* askNode = asks.Front();
+            Order& bid = bidNode->order_;
+            Order& ask = askNode->order_;
+
+            const Quantity bidShown = bid.GetDisplayedQuantity();
+            const Quantity askShown = ask.GetDisplayedQuantity();
+            const Quantity quantity = std::min(bidShown,askShown);
+            bid.Fill(quantity);
+            ask.Fill(quantity);
+            if(risk_.Enabled()){
+                risk_.OnFill(bid, quantity);
+                risk_.OnFill(ask, quantity);
+            }
+
+            trades(Trade{TradeInfo{bid.GetOrderId(), price, quantity}, TradeInfo{ask.GetOrderId(), price, quantity}});
+            UpdateLevelData(Side::Buy, bidPrice, quantity, bid.IsFilled() ? LevelData::Action::REMOVE : LevelData::Action::MATCH);
+            UpdateLevelData(Side::Sell, askPrice, quantity, ask.IsFilled() ? LevelData::Action::REMOVE : LevelData::Action::MATCH);
+            OnTrade(price, quantity);
+            OnTrade(price, quantity);
+
+            if(bid.IsFilled()){
+                bids.PopFront();
+                EraseOrderEntry(bid.GetOrderId());
+                pool_.Release(bidNode);
+            }
+            else if(quantity == bidShown)
+                Replenish(bids, bidNode);
+            if(ask.IsFilled()){
+                asks.PopFront();
+                EraseOrderEntry(ask.GetOrderId());
+                pool_.Release(askNode);
+            }
+            else if(quantity == askShown)
+                Replenish(asks, askNode);
+        }
+
+        if(bids.Empty())
+            bids_.Erase(bidPrice);
+        if(asks.Empty())
+            asks_.Erase(askPrice);
+    }
+    return result;
+}
+
+/* lock held, one pass over the crossed levels only, their aggregates not their orders */
+template<typename Policy>
+AuctionResult BasicOrderbook<Policy>::ComputeEquilibrium()
+{
+    auctionBids_.clear();
+    auctionAsks_.clear();
+    if(bids_.Empty() || asks_.Empty() || bids_.BestPrice() < asks_.BestPrice())
+        return {};
+
+    const Price bestBid = bids_.BestPrice(), bestAsk = asks_.BestPrice();
+    asks_.ForEachLevelDataUpTo(bestBid, [this](Price price, const LevelData& data){
+        auctionAsks_.push_back(LevelInfo{price, data.quantity_ + data.hidden_}); // hidden quantity trades in the uncross too
+    });
+    bids_.ForEachLevelDataUpTo(bestAsk, [this](Price price, const LevelData& data){
+        auctionBids_.push_back(LevelInfo{price, data.quantity_ + data.hidden_});
+    });
+    return FindEquilibrium(auctionAsks_, auctionBids_, AuctionReference());
+}
+
+/* lock held, the same answer as ComputeEquilibrium without walking the crossed levels, for every
+ * change while the auction runs
+ * supply(p) - demand(p) only grows with p, so a binary search over the ladders' depth finds p*, the
+ * lowest price where supply covers demand
+ * below p* the volume is the supply and above it the demand, so no level price beats the highest
+ * level below p* or the lowest one from p* up, and only the level next to either can tie with it
+ */
+template<typename Policy>
+AuctionResult BasicOrderbook<Policy>::ComputeIndicative() const
+{
+    if(bids_.Empty() || asks_.Empty() || bids_.BestPrice() < asks_.BestPrice())
+        return {};
+
+    const Price bestBid = bids_.BestPrice(), bestAsk = asks_.BestPrice();
+    std::int64_t low = bestAsk, high = static_cast<std::int64_t>(bestBid) + 1; // nothing is bid above the best bid
+    while(low < high){
+        const std::int64_t middle = low + (high - low) / 2;
+        if(asks_.DepthAt(static_cast<Price>(middle)) >= bids_.DepthAt(static_cast<Price>(middle)))
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    // closest level on either side of the book
+    auto LevelBelow = [this](Price price, Price& level){
+        Price bid{}, ask{};
+        const bool hasBid = bids_.LevelBelow(price, bid), hasAsk = asks_.LevelBelow(price, ask);
+        level = hasBid && (!hasAsk || bid > ask) ? bid : ask;
+        return hasBid || hasAsk;
+    };
+    auto LevelAtOrAbove = [this](Price price, Price& level){
+        Price bid{}, ask{};
+        const bool hasBid = bids_.LevelAtOrAbove(price, bid), hasAsk = asks_.LevelAtOrAbove(price, ask);
+        level = hasBid && (!hasAsk || bid < ask) ? bid : ask;
+        return hasBid || hasAsk;
+    };
+
+    Price left{}, leftmost{}, right{}, rightmost{};
+    bool hasLeft, hasRight;
+    if(low > bestBid){
+        // demand is never covered inside the cross, nothing from p* up trades
+        left = bestBid;
+        hasLeft = true;
+        hasRight = false;
+    }
+    else {
+        hasLeft = LevelBelow(static_cast<Price>(low), left);
+        hasRight = LevelAtOrAbove(static_cast<Price>(low), right);
+    }
+    const bool hasLeftmost = hasLeft && LevelBelow(left, leftmost);
+    const bool hasRightmost = hasRight && right < bestBid && LevelAtOrAbove(right + 1, rightmost);
+
+    const Price reference = AuctionReference();
+    AuctionResult best;
+    auto Consider = [&](bool has, Price price){
+        if(!has) return;
+        const std::uint64_t demand = bids_.DepthAt(price), supply = asks_.DepthAt(price);
+        const AuctionResult candidate{price, std::min(demand, supply), demand > supply ? demand - supply : supply - demand};
+        if(BetterUncross(candidate, best, reference))
+            best = candidate;
+    };
+    // lowest first, as FindEquilibrium goes
+    Consider(hasLeftmost, leftmost);
+    Consider(hasLeft, left);
+    Consider(hasRight, right);
+    Consider(hasRightmost, rightmost);
+    return best;
+}
+
+/* the last trade, or the middle of the crossed range before there is one */
+template<typename Policy>
+Price BasicOrderbook<Policy>::AuctionReference() const
+{
+    if(totalVolumeTraded_ > 0)
+        return lastTradedPrice_;
+    return static_cast<Price>((static_cast<std::int64_t>(bids_.BestPrice()) + asks_.BestPrice()) / 2);
+}
+
+/* can a level change at this price move the uncross, only levels the other side reaches can */
+template<typename Policy>
+bool BasicOrderbook<Policy>::Crosses(Side side, Price price) const
+{
+    if(side==Side::Buy)
+        return !asks_.Empty() && price >= asks_.BestPrice();
+    return !bids_.Empty() && price <= bids_.BestPrice();
 }
 
 /* to modify the order */
-Trades Orderbook::ModifyOrder(OrderModify order)
+template<typename Policy>
+Trades BasicOrderbook<Policy>::ModifyOrder(OrderModify order)
+{
+    Trades trades;
+    ModifyOrder(order, trades);
+    return trades;
+}
+
+/* amend in one critical section, the order keeps its node, its id entry and its deadline
+ * same side and price without growing: change the quantity where it is, it keeps its place in the queue
+ * anything else: move the same node to the back of its new level and match it like a new order
+ * amending down to nothing is a cancel
+ */
+template<typename Policy>
+RejectReason BasicOrderbook<Policy>::ModifyOrder(const OrderModify& modify, TradeSink trades)
+{
+    std::scoped_lock ordersLock{ordersMutex_};
+    const RejectReason reason = ModifyOrderInternal(modify, trades);
+    PublishMarketData();
+    return reason;
+}
+
+/* lock held, an amend that moves the order is risk checked like a new one and left as it was if rejected */
+template<typename Policy>
+RejectReason BasicOrderbook<Policy>::ModifyOrderInternal(const OrderModify& modify, TradeSink trades)
 {
-    if(orders_.find(order.GetOrderId())==orders_.end()) return Trades{};
+    auto entry = orders_.find(modify.GetOrderId());
+    if(entry==orders_.end()) return RejectReason::UnknownOrder;
+
+    OrderNode* node = entry->second.node_;
+    Order& order = node->order_;
+    const bool inPlace = modify.GetSide()==order.GetSide() && modify.GetPrice()==order.GetPrice()
+        && modify.GetQuantity()<=order.GetRemainingQuantity();
+
+    if(!inPlace && modify.GetQuantity()!=0 && risk_.Enabled()){
+        const RejectReason reason = risk_.CheckReplace(order, modify.GetSide(), modify.GetPrice(),
+                                                       modify.GetQuantity(), RiskReference(modify.GetSide()));
+        if(reason != RejectReason::None)
+            return reason;
+    }
 
-    const auto &[existingOrder,_] = orders_[order.GetOrderId()];
-    CancelOrder(order.GetOrderId());
-    return AddOrder(order.ToOrderPointer(existingOrder->GetOrderType()));
+    Journal(Command::Modify(modify));
+    if(modify.GetQuantity()==0){
+        CancelOrderInternal(modify.GetOrderId());
+        return RejectReason::None;
+    }
+
+    if(inPlace){
+        const Quantity reduction = order.GetRemainingQuantity() - modify.GetQuantity();
+        if(reduction==0) return RejectReason::None;
+        if(risk_.Enabled())
+            risk_.OnReleased(order, reduction);
+        // an iceberg gives up hidden quantity first
+        const Quantity shown = order.GetDisplayedQuantity();
+        order.ReduceTo(modify.GetQuantity());
+        const Quantity shownCut = shown - order.GetDisplayedQuantity();
+        UpdateLevelData(order.GetSide(), order.GetPrice(), shownCut, LevelData::Action::REDUCE, reduction - shownCut);
+        return RejectReason::None; // same price, nothing new can cross
+    }
+
+    if(risk_.Enabled())
+        risk_.OnReleased(order, order.GetRemainingQuantity());
+    UnlinkOrder(node);
+    order.Replace(modify.GetSide(), modify.GetPrice(), modify.GetQuantity());
+    if(risk_.Enabled())
+        risk_.OnAccepted(order);
+    LinkOrder(node);
+    OnOrderAdded(order);
+    if(!auction_)
+        MatchOrders(trades);
+    return RejectReason::None;
 }
 
 
 /* to get information about levels on both sides  */
-OrderbookLevelInfos Orderbook::GetOrderInfos() const
+template<typename Policy>
+OrderbookLevelInfos BasicOrderbook<Policy>::GetOrderInfos() const
 {
+    if(publishDepth_){
+        const auto depth = ReadDepth();
+        return OrderbookLevelInfos{depth->bids_, depth->asks_};
+    }
+    return GetDepth(std::numeric_limits<std::size_t>::max());
+}
+
+/* each level keeps the quantity it shows, so no need to sum the orders again, iceberg reserves stay hidden */
+template<typename Policy>
+OrderbookLevelInfos BasicOrderbook<Policy>::GetDepth(std::size_t levels) const
+{
+    std::scoped_lock ordersLock{ordersMutex_};
+
     LevelInfos bidInfos,askInfos;
-    bidInfos.reserve(orders_.size());
-    askInfos.reserve(orders_.size());
-
-    auto CreateLevelInfos = [](Price price,const OrderPointers& orders){
-        // return for a price how many quantities are there
-        return LevelInfo{
-            price,
-            std::accumulate(
-                orders.begin(),
-                orders.end(),
-                (Quantity)0,
-            [](Quantity runningSum,const OrderPointer& order){
-                    return runningSum + order->GetRemainingQuantity();
-                }
-            )
-        };
-    };
+    bidInfos.reserve(std::min(levels, bids_.Size()));
+    askInfos.reserve(std::min(levels, asks_.Size()));
+
+    bids_.ForEachLevelData(levels, [&](Price price,const LevelData& data){
+        bidInfos.push_back(LevelInfo{price, data.quantity_});
+    });
+    asks_.ForEachLevelData(levels, [&](Price price,const LevelData& data){
+        askInfos.push_back(LevelInfo{price, data.quantity_});
+    });
+    return OrderbookLevelInfos{bidInfos,askInfos};
+}
 
-   for(const auto& [price,order]: bids_){
-       bidInfos.push_back(CreateLevelInfos(price,order));
-   }
-   for(const auto& [price,order]: asks_){
-       askInfos.push_back(CreateLevelInfos(price,order));
-   }
-   return OrderbookLevelInfos{bidInfos,askInfos};
+template<typename Policy>
+void BasicOrderbook<Policy>::DrainLevelUpdates(LevelUpdates& updates)
+{
+    updates.clear();
+    std::scoped_lock ordersLock{ordersMutex_};
+    std::swap(updates, levelUpdates_);
 }
 
 /* Event based methods */
 
-void Orderbook::OnOrderCancelled(OrderPointer order){
-    UpdateLevelData(order->GetPrice(), order->GetRemainingQuantity(), LevelData::Action::REMOVE);
+template<typename Policy>
+void BasicOrderbook<Policy>::OnOrderCancelled(const Order& order){
+    const Quantity shown = order.GetDisplayedQuantity();
+    UpdateLevelData(order.GetSide(), order.GetPrice(), shown, LevelData::Action::REMOVE, order.GetRemainingQuantity() - shown);
+}
+
+template<typename Policy>
+void BasicOrderbook<Policy>::OnOrderAdded(const Order& order){
+    const Quantity shown = order.GetDisplayedQuantity();
+    UpdateLevelData(order.GetSide(),order.GetPrice(),shown,LevelData::Action::ADD,order.GetRemainingQuantity() - shown);
 }
 
-void Orderbook::OnOrderAdded(OrderPointer order){
-    UpdateLevelData(order->GetPrice(),order->GetInitialQuantity(),LevelData::Action::ADD);
+template<typename Policy>
+void BasicOrderbook<Policy>::OnOrderMatched(Side side,Price price,Quantity quantity, bool isFullyFilled){
+    UpdateLevelData(side, price, quantity, isFullyFilled? LevelData::Action::REMOVE : LevelData::Action::MATCH);
+    OnTrade(price, quantity);
 }
 
-void Orderbook::OnOrderMatched(Price price,Quantity quantity, bool isFullyFilled){
-    UpdateLevelData(price, quantity, isFullyFilled? LevelData::Action::REMOVE : LevelData::Action::MATCH);
+/* market stats count every fill once per side */
+template<typename Policy>
+void BasicOrderbook<Policy>::OnTrade(Price price,Quantity quantity){
     lastTradedPrice_ = price;
     totalVolumeTraded_ += quantity;
     priceVolumeSum_ += static_cast<std::uint64_t>(price) * quantity;
 }
 
-void Orderbook::UpdateLevelData(Price price,Quantity quantity,LevelData::Action action){
-    auto& data = data_[price];
-    data.count_ += action==LevelData::Action::REMOVE ? -1 : action==LevelData::Action::ADD ? 1 : 0;
+/* level data is kept per side inside the ladders, next to the orders of the level
+ * every change goes through here, so this is also where the L2 deltas come from
+ */
+template<typename Policy>
+void BasicOrderbook<Policy>::UpdateLevelData(Side side,Price price,Quantity quantity,LevelData::Action action,Quantity hidden){
+    const LevelData& data = side==Side::Buy
+        ? bids_.UpdateLevelData(price, quantity, action, hidden)
+        : asks_.UpdateLevelData(price, quantity, action, hidden);
+
+    if(publishLevelUpdates_)
+        levelUpdates_.push_back(LevelUpdate{side, price, data.quantity_, data.count_});
+    depthChanged_ = true;
+    if(auction_ && !indicativeChanged_ && Crosses(side, price))
+        indicativeChanged_ = true;
+}
 
-    if(action==LevelData::Action::REMOVE || action==LevelData::Action::MATCH){
-        data.quantity_ -= quantity;
+/* lock held, at the end of every public call that can change the book */
+template<typename Policy>
+void BasicOrderbook<Policy>::PublishMarketData(){
+    if(auction_ && indicativeChanged_){
+        indicative_ = ComputeIndicative();
+        indicativeChanged_ = false;
     }
-    else{
-        data.quantity_ += quantity;
+    PublishTopOfBook();
+    if(publishDepth_ && depthChanged_)
+        PublishDepth();
+}
+
+/* lock held, at the end of every public call that can change the book
+ * nothing is stored when the call left the top of the book and the stats alone, like most deep cancels
+ */
+template<typename Policy>
+void BasicOrderbook<Policy>::PublishTopOfBook(){
+    TopOfBook top;
+    if(!bids_.Empty()){
+        top.bestBid_ = bids_.BestPrice();
+        top.bidQuantity_ = bids_.BestData().quantity_;
+    }
+    if(!asks_.Empty()){
+        top.bestAsk_ = asks_.BestPrice();
+        top.askQuantity_ = asks_.BestData().quantity_;
     }
+    top.lastTradedPrice_ = lastTradedPrice_;
+    top.totalVolumeTraded_ = totalVolumeTraded_;
+    top.priceVolumeSum_ = priceVolumeSum_;
+    top.orders_ = orders_.size();
+    top.bidLevels_ = static_cast<std::uint32_t>(bids_.Size());
+    top.askLevels_ = static_cast<std::uint32_t>(asks_.Size());
+    top.auction_ = auction_;
+    top.indicativePrice_ = indicative_.price_;
+    top.indicativeVolume_ = indicative_.volume_;
+
+    if(top == published_)
+        return;
+    published_ = top;
+    topOfBook_.Store(top);
+}
 
-    if(data.count_==0)
-        data_.erase(price);
+/* the whole depth again from the level aggregates, into a snapshot no reader is on any more
+ * its vectors kept their capacity from when it was last published, so this does not allocate either
+ */
+template<typename Policy>
+void BasicOrderbook<Policy>::PublishDepth(){
+    DepthSnapshot& depth = depth_.Prepare();
+    depth.bids_.clear();
+    depth.asks_.clear();
+    bids_.ForEachLevelData(std::numeric_limits<std::size_t>::max(), [&depth](Price price,const LevelData& data){
+        depth.bids_.push_back(LevelInfo{price, data.quantity_});
+    });
+    asks_.ForEachLevelData(std::numeric_limits<std::size_t>::max(), [&depth](Price price,const LevelData& data){
+        depth.asks_.push_back(LevelInfo{price, data.quantity_});
+    });
+    depth.version_ = depth_.Current().version_ + 1;
+    depth_.Publish();
+    depthChanged_ = false;
 }
 
 
@@ -422,7 +1167,8 @@ std::string DepthBar(int quantity, int maxQty, bool isBid) {
     return (isBid ? GREEN : RED) + bar + RESET;
 }
 
-void Orderbook::PrintOrderbook() const{
+template<typename Policy>
+void BasicOrderbook<Policy>::PrintOrderbook() const{
     OrderbookLevelInfos info = GetOrderInfos();
     const LevelInfos& bids = info.GetBids();
     const LevelInfos& asks = info.GetAsks();
@@ -490,40 +1236,46 @@ void Orderbook::PrintOrderbook() const{
 }
 
 
-void Orderbook::PrintMarketStats() const {
+template<typename Policy>
+void BasicOrderbook<Policy>::PrintMarketStats() const {
+    // one consistent view without stopping the book
+    const TopOfBook top = GetTopOfBook();
     std::cout << "========= Market Info =========\n";
 
-    if (!bids_.empty()) {
-        auto bestBid = bids_.begin();
-        std::cout << "Best Bid: ₹" << bestBid->first << " (Qty: " << bestBid->second.front()->GetRemainingQuantity() << ")\n";
+    if (top.HasBid()) {
+        std::cout << "Best Bid: ₹" << top.bestBid_ << " (Qty: " << top.bidQuantity_ << ")\n";
     } else {
         std::cout << "Best Bid: None\n";
     }
 
-    if (!asks_.empty()) {
-        auto bestAsk = asks_.begin();
-        std::cout << "Best Ask: ₹" << bestAsk->first << " (Qty: " << bestAsk->second.front()->GetRemainingQuantity() << ")\n";
+    if (top.HasAsk()) {
+        std::cout << "Best Ask: ₹" << top.bestAsk_ << " (Qty: " << top.askQuantity_ << ")\n";
     } else {
         std::cout << "Best Ask: None\n";
     }
 
-    if (!asks_.empty() && !bids_.empty())
-        std::cout << "Spread: ₹" << (asks_.begin()->first - bids_.begin()->first) << "\n";
+    if (top.HasAsk() && top.HasBid())
+        std::cout << "Spread: ₹" << (top.bestAsk_ - top.bestBid_) << "\n";
     else
         std::cout << "Spread: N/A\n";
 
-    std::cout << "\nTotal Buy Orders: " << bids_.size() << "\n";
-    std::cout << "Total Sell Orders: " << asks_.size() << "\n";
-    std::cout << "Total Orders in Book: " << Size() << "\n";
+    std::cout << "\nBid Levels: " << top.bidLevels_ << "\n";
+    std::cout << "Ask Levels: " << top.askLevels_ << "\n";
+    std::cout << "Total Orders in Book: " << top.orders_ << "\n";
 
-    if (totalVolumeTraded_ > 0) {
-        std::cout << "\nLast Traded Price: ₹" << lastTradedPrice_ << "\n";
-        std::cout << "Total Volume Traded: " << totalVolumeTraded_ << "\n";
-        double vwap = static_cast<double>(priceVolumeSum_) / totalVolumeTraded_;
-        std::cout << "VWAP: ₹" << std::fixed << std::setprecision(2) << vwap << "\n";
+    if (top.auction_)
+        std::cout << "\nIn auction, indicative uncross: " << top.indicativeVolume_ << " @ ₹" << top.indicativePrice_ << "\n";
+
+    if (top.totalVolumeTraded_ > 0) {
+        std::cout << "\nLast Traded Price: ₹" << top.lastTradedPrice_ << "\n";
+        std::cout << "Total Volume Traded: " << top.totalVolumeTraded_ << "\n";
+        std::cout << "VWAP: ₹" << std::fixed << std::setprecision(2) << top.Vwap() << "\n";
     } else {
         std::cout << "\nNo trades yet.\n";
     }
 
     std::cout << "==============================\n\n";
 }
+
+template class BasicOrderbook<DefaultOrderbookPolicy>;
+template class BasicOrderbook<SingleThreadedOrderbookPolicy>;
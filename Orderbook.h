@@ -1,91 +1,248 @@
 #pragma once
 
-#include <map>
-#include <unordered_map>
 #include <thread>
 #include <condition_variable>
 #include <mutex>
 #include <numeric>
 #include <atomic>
+#include <chrono>
+#include <span>
+#include <string>
+#include <type_traits>
 #include "Usings.h"
+#include "Auction.h"
+#include "Command.h"
+#include "DepthSnapshot.h"
+#include "ExecutionReport.h"
+#include "EpochPublisher.h"
+#include "ExpiryIndex.h"
+#include "LevelData.h"
+#include "LevelUpdate.h"
 #include "Order.h"
+#include "OrderPool.h"
+#include "OrderQueue.h"
+#include "OrderbookConfig.h"
+#include "OrderbookPolicy.h"
+#include "PreTradeRisk.h"
+#include "PriceLadder.h"
+#include "Seqlock.h"
 #include "OrderModify.h"
 #include "OrderbookLevelInfos.h"
 #include "Trade.h"
+#include "TopOfBook.h"
+#include "TradeSink.h"
 
+class JournalWriter;
 
 /* Orderbook */
 /*
  *
- * storing orders in map
+ * storing orders in a price ladder per side (flat array around the market, map outside it)
  * bids are sorted in descending order - best bid first (paying more to buy)
  * asks are sorted in ascending order -  best ask first (aksing less to sell)
+ *
+ * resting orders live in a preallocated pool and each level is an intrusive FIFO over it,
+ * so once the pool is warm adding, cancelling and matching do not allocate orders
+ *
+ * GoodForDay and GoodTillTime orders are also scheduled in an expiry index (see ExpiryIndex.h)
+ * and expired a batch at a time, at the session close or at their deadline
+ *
+ * what backs the levels and the id map, how it is locked and whether it runs its own
+ * expiry thread come from the Policy (see OrderbookPolicy.h), Orderbook is the default
+ *
+ * icebergs rest with part of their quantity hidden (see Order.h), every time what they show
+ * runs out they show the next peak and go to the back of their level
+ *
+ * matching is continuous except during a call auction (see Auction.h), then orders rest
+ * without matching until Uncross trades everything that crosses at one price
  */
-class Orderbook {
+template<typename Policy>
+class BasicOrderbook {
 private:
-    struct OrderEntry{ // Store pointer to order
-        OrderPointer order_{nullptr};
-        OrderPointers::iterator location_; // for quick access
-    };
-
-    struct LevelData{
-        Quantity quantity_{};
-        Quantity count_{};
+    using Mutex = typename Policy::Mutex;
+    // condition_variable only waits on a std::mutex
+    using ConditionVariable = std::conditional_t<std::is_same_v<Mutex, std::mutex>,
+        std::condition_variable, std::condition_variable_any>;
 
-        enum class Action {
-            ADD,
-            REMOVE,
-            MATCH
-        };
+    struct OrderEntry{ // Store node of order in the pool
+        OrderNode* node_{nullptr}; // also its place in the level queue, for quick access
+        ExpiryIndex::Handle expiry_; // None() unless the order can expire
     };
-    std::unordered_map<Price, LevelData> data_;
+
     // for a price store order pointers
-    std::map<Price,OrderPointers,std::greater<Price>> bids_; // highest bid to lowest bid
-    std::map<Price,OrderPointers,std::less<Price>> asks_; // lowest ask to highest ask
-    std::unordered_map<OrderId,OrderEntry> orders_;
+    typename Policy::template Levels<Side::Buy> bids_; // highest bid to lowest bid
+    typename Policy::template Levels<Side::Sell> asks_; // lowest ask to highest ask
+    typename Policy::template OrderIndex<OrderEntry> orders_;
+    OrderPool pool_;
+    ExpiryIndex expiries_;
+    OrderIds expiring_; // scratch for the batch being expired
+    std::size_t expiryBatch_;
+    std::chrono::seconds sessionClose_;
     //
-    mutable std::mutex ordersMutex_;
+    mutable Mutex ordersMutex_;
     std::thread ordersPruneThread_;
-    std::condition_variable shutdownConditionVariable_;
+    ConditionVariable expiryConditionVariable_;
     std::atomic<bool> shutdown_{false};
+    bool wakeExpiry_{false}; // an earlier deadline came in, guarded by ordersMutex_
+
+    JournalWriter* journal_{nullptr}; // not owned, null when not journaling
+    bool publishLevelUpdates_{false};
+    LevelUpdates levelUpdates_; // since the last drain
+    PreTradeRisk risk_;
 
-    void PruneGoodForDayOrders();
+    bool auction_{false};
+    bool indicativeChanged_{false}; // a level that crosses changed since indicative_ was worked out
+    AuctionResult indicative_;
+    LevelInfos auctionBids_, auctionAsks_; // scratch, the crossed levels at the uncross
+    bool publishDepth_{false};
+    bool depthChanged_{true}; // a level changed since the depth was last published
+
+    void ExpireOrdersThread();
+    void PruneGoodForDay(bool unlessAuction);
+    std::size_t PruneGoodForDayBatch(std::size_t maxOrders);
+    std::size_t ExpireBatch(Timestamp now, std::size_t maxOrders);
+    void Journal(const Command& command);
+
+    RejectReason ApplyInternal(const Command& command, TradeSink trades);
+    RejectReason AddOrderInternal(const Order& order, TradeSink trades);
+    RejectReason ModifyOrderInternal(const OrderModify& modify, TradeSink trades);
+    Price RiskReference(Side side) const;
+    void StartAuctionInternal();
+    AuctionResult UncrossInternal(TradeSink trades);
+    AuctionResult ComputeEquilibrium();
+    AuctionResult ComputeIndicative() const;
+    Price AuctionReference() const;
+    bool Crosses(Side side, Price price) const;
+    void EraseOrderEntry(OrderId orderId);
+    void LinkOrder(OrderNode* node);
+    void UnlinkOrder(OrderNode* node);
+    ExpiryIndex::Handle ScheduleExpiry(const Order& order);
 
     void CancelOrders(OrderIds orderIds);
+    bool CancelOrderJournaled(OrderId orderId);
     void CancelOrderInternal(OrderId orderId);
 
-    void OnOrderCancelled(OrderPointer order);
-    void OnOrderAdded(OrderPointer order);
-    void OnOrderMatched(Price price,Quantity quantity,bool isFullyFilled);
-    void UpdateLevelData(Price price,Quantity quantity,LevelData::Action action);
+    void OnOrderCancelled(const Order& order);
+    void OnOrderAdded(const Order& order);
+    void OnOrderMatched(Side side,Price price,Quantity quantity,bool isFullyFilled);
+    void OnTrade(Price price,Quantity quantity);
+    void UpdateLevelData(Side side,Price price,Quantity quantity,LevelData::Action action,Quantity hidden = 0);
+    void Replenish(OrderQueue& level, OrderNode* node);
+    void PublishMarketData();
+    void PublishTopOfBook();
+    void PublishDepth();
 
     bool CanFullyFill(Side side,Price price,Quantity quantity) const;
     bool CanMatch(Side side,Price price) const;
-    Trades MatchOrders();
+    void MatchOrders(TradeSink trades);
+    void SweepOrder(const Order& order, TradeSink trades);
 
 
     Price lastTradedPrice_{};
     Quantity totalVolumeTraded_{};
     std::uint64_t priceVolumeSum_ = 0; // for VWAP
+
+    TopOfBook published_; // what topOfBook_ holds, guarded by ordersMutex_
+    Seqlock<TopOfBook> topOfBook_;
+    EpochPublisher<DepthSnapshot> depth_;
 public:
-    Orderbook();
-    ~Orderbook();
+    explicit BasicOrderbook(const OrderbookConfig& config = {});
+    ~BasicOrderbook();
     // Orderbook(const Orderbook&) = delete;
     // void operator=(const Orderbook&) = delete;
     // Orderbook(Orderbook&&) = delete;
     // void operator=(Orderbook&&) = delete;
-    // ~Orderbook(){ shutdownConditionVariable_.notify_all();
+    // ~Orderbook(){ expiryConditionVariable_.notify_all();
     //     ordersPruneThread_.join();
     // };
 
     Trades AddOrder(OrderPointer order);
+    Trades AddOrder(const Order& order); // no allocation for the order itself
+    /* fills go to the sink as they happen, nothing is allocated for them (see TradeSink.h)
+     * None unless the order was turned away (a duplicate id or a risk check), Market / FillAndKill /
+     * FillOrKill orders that found nothing to trade with are still None
+     */
+    RejectReason AddOrder(const Order& order, TradeSink trades);
     void CancelOrder(OrderId orderId);
     Trades ModifyOrder(OrderModify order);
+    /* UnknownOrder, a risk check of the moved order, or None */
+    RejectReason ModifyOrder(const OrderModify& order, TradeSink trades);
+    /* what the expiry thread does at the close and at deadlines, for owners that run without it
+     * both go a batch at a time and let go of the book in between
+     */
+    void CancelGoodForDayOrders();
+    std::size_t ExpireOrders(Timestamp now);
+    bool Contains(OrderId orderId) const;
+    /* one command of any type, what replay and the drivers feed the book with
+     * returns why an Add / Modify was turned away, UnknownOrder for a Cancel of an order that is not there,
+     * InvalidIceberg for an Add with a peak its type cannot have and UnknownAccount for limits of an account
+     * the risk checks do not keep (or all of them while risk is off), None otherwise
+     */
+    Trades Apply(const Command& command);
+    RejectReason Apply(const Command& command, TradeSink trades);
+    /* what a gateway drained in one go, applied in order under one lock
+     * every command gets exactly what Apply would have done to it, fills of all of them go to the sink
+     * in command order, a command's own fills before the next command's
+     * results, when given, needs one per command and gets each one's reason and how many of the fills were its
+     */
+    Trades ApplyBatch(std::span<const Command> commands);
+    void ApplyBatch(std::span<const Command> commands, TradeSink trades, std::span<CommandResult> results = {});
+
+    /* call auction, for the open and the close
+     * from StartAuction on, limit orders and amends rest without matching and Market / FillAndKill /
+     * FillOrKill orders are rejected, the indicative uncross is kept up to date as orders come and go
+     * Uncross trades everything that crosses at the equilibrium price and goes back to continuous matching
+     * with closeSession the GoodForDay orders go too, under the same lock, so nothing slips in between
+     * (the expiry thread leaves them alone while a closing auction runs past the close)
+     * both are journaled, and a snapshot taken during an auction loads back into it
+     */
+    void StartAuction();
+    AuctionResult Uncross(TradeSink trades, bool closeSession = false);
+    bool InAuction() const;
+    AuctionResult GetIndicativeUncross() const;
+
+    /* pre trade risk, with OrderbookConfig::risk_ enabled (see PreTradeRisk.h) */
+    void SetAccountLimits(AccountId account, const AccountLimits& limits);
+    AccountRisk GetAccountRisk(AccountId account) const;
 
-    /* to know how many orders are in the orderbook */
-    std::size_t Size() const {return orders_.size();}
+    /* every accepted command is appended to the journal from now on, pass null to stop */
+    void AttachJournal(JournalWriter* journal);
+
+    /* resting orders and market stats to a file (see Snapshot.h)
+     * both return the journal sequence to replay from to catch up with the live book
+     * saving flushes the attached journal first, so every record before that sequence is in the file
+     */
+    std::uint64_t SaveSnapshot(const std::string& path) const;
+    std::uint64_t LoadSnapshot(const std::string& path);
+
+    /* best bid / ask, last trade and VWAP as of the last call that changed them
+     * safe from any thread and never takes the book's lock, so polling it does not slow matching
+     */
+    TopOfBook GetTopOfBook() const {return topOfBook_.Load();}
+    /* to know how many orders are in the orderbook, from the published top of book too */
+    std::size_t Size() const {return static_cast<std::size_t>(topOfBook_.Load().orders_);}
+    using DepthReader = EpochPublisher<DepthSnapshot>::Reader;
+    /* every level as of the last call that changed any, with OrderbookConfig::depthSnapshots_ on
+     * from any thread without the book's lock, the snapshot stays as it is for as long as the reader is held
+     * otherwise it stays empty
+     */
+    DepthReader ReadDepth() const {return depth_.Read();}
+    /* a copy of every level, from the published depth when there is one */
     OrderbookLevelInfos GetOrderInfos() const;
+    /* best levels per side from the kept aggregates, costs the levels returned not the orders */
+    OrderbookLevelInfos GetDepth(std::size_t levels) const;
+    /* hand over the level updates since the last drain, updates is cleared first
+     * swap based so neither side allocates once both vectors are warm
+     */
+    void DrainLevelUpdates(LevelUpdates& updates);
     void PrintOrderbook() const;
     void PrintMarketStats() const;
 
 };
+
+/* members are defined in Orderbook.cpp / Snapshot.cpp and built there for these policies */
+extern template class BasicOrderbook<DefaultOrderbookPolicy>;
+extern template class BasicOrderbook<SingleThreadedOrderbookPolicy>;
+
+using Orderbook = BasicOrderbook<DefaultOrderbookPolicy>;
+using SingleThreadedOrderbook = BasicOrderbook<SingleThreadedOrderbookPolicy>;
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <random>
+#include <vector>
+#include "../Command.h"
+
+/* Synthetic order flow */
+/*
+ * a seeded generator so two runs with the same config see exactly the same commands
+ *
+ * passive orders (GoodTillCancel, GoodForDay) rest up to levels_ ticks away from the mid,
+ * most of them close to it, and crossPercent_ of them are priced through the mid so they trade
+ * aggressive orders (FillAndKill, FillOrKill) are priced a few ticks through the mid
+ * cancels and modifies pick a random order that was added earlier and may still rest
+ */
+
+struct OrderFlowConfig {
+    std::uint64_t seed_ = 42;
+    Price mid_ = 10'000;
+    Price levels_ = 50;
+    unsigned crossPercent_ = 10;
+    Quantity minQuantity_ = 1;
+    Quantity maxQuantity_ = 100;
+    std::array<unsigned, 3> actionMix_{60, 30, 10};   // add, cancel, modify
+    std::array<unsigned, 5> typeMix_{80, 10, 5, 0, 5}; // indexed by OrderType
+};
+
+class OrderFlow {
+public:
+    explicit OrderFlow(const OrderFlowConfig& config)
+    : config_{config}, rng_{config.seed_},
+      action_{config.actionMix_.begin(), config.actionMix_.end()},
+      type_{config.typeMix_.begin(), config.typeMix_.end()},
+      offset_{std::min(1.0, 4.0 / std::max<Price>(config.levels_, 1))},
+      quantity_{config.minQuantity_, config.maxQuantity_}
+    {}
+
+    Command Next(){
+        switch(action_(rng_)){
+            case 1: if(!live_.empty()) return NextCancel(); break;
+            case 2: if(!live_.empty()) return NextModify(); break;
+            default: break;
+        }
+        return NextAdd(static_cast<OrderType>(type_(rng_)));
+    }
+
+    /* resting order, used to build up depth before measuring */
+    Command NextPassive(){
+        return NextAdd(OrderType::GoodTillCancel, false);
+    }
+
+private:
+    Command NextAdd(OrderType type, bool mayCross = true){
+        const Side side = coin_(rng_) ? Side::Buy : Side::Sell;
+        const OrderId orderId = nextOrderId_++;
+
+        Price price = 0;
+        if(type == OrderType::FillAndKill || type == OrderType::FillOrKill)
+            price = Through(side);
+        else if(type != OrderType::Market)
+            price = mayCross && percent_(rng_) < config_.crossPercent_ ? Through(side) : Passive(side);
+
+        if(type == OrderType::GoodTillCancel || type == OrderType::GoodForDay)
+            live_.push_back(orderId);
+
+        return Command::Add(Order{type, orderId, side, price, quantity_(rng_)});
+    }
+
+    Command NextCancel(){
+        const auto index = Pick();
+        const OrderId orderId = live_[index];
+        live_[index] = live_.back();
+        live_.pop_back();
+        return Command::Cancel(orderId);
+    }
+
+    Command NextModify(){
+        const OrderId orderId = live_[Pick()];
+        const Side side = coin_(rng_) ? Side::Buy : Side::Sell;
+        return Command::Modify(OrderModify{orderId, side, Passive(side), quantity_(rng_)});
+    }
+
+    std::size_t Pick(){
+        return std::uniform_int_distribution<std::size_t>{0, live_.size() - 1}(rng_);
+    }
+
+    /* at or behind the touch, geometric so the inside levels are the busiest */
+    Price Passive(Side side){
+        const Price offset = 1 + std::min<Price>(offset_(rng_), config_.levels_ - 1);
+        return side == Side::Buy ? config_.mid_ - offset : config_.mid_ + offset;
+    }
+
+    Price Through(Side side){
+        const Price offset = 1 + std::min<Price>(offset_(rng_), 4);
+        return side == Side::Buy ? config_.mid_ + offset : config_.mid_ - offset;
+    }
+
+    OrderFlowConfig config_;
+    std::mt19937_64 rng_;
+    std::discrete_distribution<int> action_;
+    std::discrete_distribution<int> type_;
+    std::geometric_distribution<Price> offset_;
+    std::uniform_int_distribution<Quantity> quantity_;
+    std::bernoulli_distribution coin_{0.5};
+    std::uniform_int_distribution<unsigned> percent_{0, 99};
+
+    OrderId nextOrderId_{1};
+    std::vector<OrderId> live_;
+};
+
+/* the A / M / C / P / E / S / U / L text format used by the test files, read back by CommandParser.h */
+inline void WriteCommand(std::ostream& out, const Command& command)
+{
+    const char* side = command.side_ == Side::Buy ? "B" : "S";
+    switch(command.type_){
+        case CommandType::Add:
+        {
+            static constexpr const char* Types[] = {"GoodTillCancel", "FillAndKill", "FillOrKill", "GoodForDay", "Market", "GoodTillTime"};
+            out << "A " << side << ' ' << Types[static_cast<int>(command.orderType_)] << ' '
+                << command.price_ << ' ' << command.quantity_ << ' ' << command.orderId_;
+            if(command.orderType_ == OrderType::GoodTillTime)
+                out << ' ' << command.time_;
+            else if(command.peak_ != 0)
+                out << ' ' << command.peak_;
+            out << '\n';
+            break;
+        }
+        case CommandType::Modify:
+            out << "M " << command.orderId_ << ' ' << side << ' ' << command.price_ << ' ' << command.quantity_ << '\n';
+            break;
+        case CommandType::Cancel:
+            out << "C " << command.orderId_ << '\n';
+            break;
+        case CommandType::PruneGoodForDay:
+            out << "P\n";
+            break;
+        case CommandType::Expire:
+            out << "E " << command.time_ << '\n';
+            break;
+        case CommandType::AuctionStart:
+            out << "S\n";
+            break;
+        case CommandType::AuctionUncross:
+            out << "U\n";
+            break;
+        case CommandType::SetAccountLimits:
+            out << "L " << command.account_ << ' ' << command.time_ << ' ' << command.orderId_ << '\n';
+            break;
+    }
+}
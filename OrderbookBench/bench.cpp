@@ -0,0 +1,183 @@
+#include "../Orderbook.h"
+#include "../Instrumentation.h"
+#include "../LatencyHistogram.h"
+#include "OrderFlow.h"
+
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+/* Orderbook benchmark */
+/*
+ * drives one book with synthetic flow (see OrderFlow.h) and times every call
+ * prints throughput and p50/p99/p99.9/max per operation
+ *
+ *   ./orderbook_bench_bin --ops=1000000 --prefill=10000 --levels=50 --mix=60,30,10 --types=80,10,5,0,5
+ *   ./orderbook_bench_bin --emit=flow.txt    writes the flow in the A/M/C text format instead
+ *
+ * built with INSTRUMENT=1 it also prints the add path per stage (see Instrumentation.h),
+ * --stages=stages.csv writes the same as CSV
+ */
+
+namespace {
+
+struct BenchConfig {
+    OrderFlowConfig flow_;
+    std::uint64_t ops_ = 1'000'000;
+    std::uint64_t prefill_ = 10'000;
+    std::string emit_;
+    std::string stages_;
+};
+
+template<typename T>
+bool ParseNumber(std::string_view text, T& value)
+{
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc{} && end == text.data() + text.size();
+}
+
+template<std::size_t N>
+bool ParseList(std::string_view text, std::array<unsigned, N>& values)
+{
+    for(std::size_t i = 0; i < N; ++i){
+        const auto comma = text.find(',');
+        if(!ParseNumber(text.substr(0, comma), values[i]))
+            return false;
+        if(comma == std::string_view::npos)
+            return i == N - 1;
+        text.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+bool ParseArguments(int argc, char** argv, BenchConfig& config)
+{
+    for(int i = 1; i < argc; ++i){
+        const std::string_view argument{argv[i]};
+        const auto equals = argument.find('=');
+        if(argument.substr(0, 2) != "--" || equals == std::string_view::npos)
+            return false;
+
+        const auto key = argument.substr(2, equals - 2);
+        const auto value = argument.substr(equals + 1);
+        bool ok = true;
+        if(key == "ops") ok = ParseNumber(value, config.ops_);
+        else if(key == "prefill") ok = ParseNumber(value, config.prefill_);
+        else if(key == "seed") ok = ParseNumber(value, config.flow_.seed_);
+        else if(key == "mid") ok = ParseNumber(value, config.flow_.mid_);
+        else if(key == "levels") ok = ParseNumber(value, config.flow_.levels_);
+        else if(key == "cross") ok = ParseNumber(value, config.flow_.crossPercent_);
+        else if(key == "minqty") ok = ParseNumber(value, config.flow_.minQuantity_);
+        else if(key == "maxqty") ok = ParseNumber(value, config.flow_.maxQuantity_);
+        else if(key == "mix") ok = ParseList(value, config.flow_.actionMix_);
+        else if(key == "types") ok = ParseList(value, config.flow_.typeMix_);
+        else if(key == "emit") config.emit_ = value;
+        else if(key == "stages") config.stages_ = value;
+        else ok = false;
+
+        if(!ok)
+            return false;
+    }
+    return true;
+}
+
+void PrintRow(const char* name, const LatencyHistogram& histogram)
+{
+    std::printf("%-8s %10llu %9.1f %8llu %8llu %8llu %10llu\n", name,
+                static_cast<unsigned long long>(histogram.Count()), histogram.Mean(),
+                static_cast<unsigned long long>(histogram.Percentile(50)),
+                static_cast<unsigned long long>(histogram.Percentile(99)),
+                static_cast<unsigned long long>(histogram.Percentile(99.9)),
+                static_cast<unsigned long long>(histogram.Max()));
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    if(!ParseArguments(argc, argv, config)){
+        std::cerr << "usage: " << argv[0] << " [--ops=N] [--prefill=N] [--seed=N] [--mid=P] [--levels=N] [--cross=PCT]\n"
+                  << "       [--minqty=Q] [--maxqty=Q] [--mix=add,cancel,modify] [--types=gtc,fak,fok,gfd,mkt] [--emit=FILE]\n"
+                  << "       [--stages=FILE]\n";
+        return 1;
+    }
+
+    OrderFlow flow{config.flow_};
+
+    if(!config.emit_.empty()){
+        std::ofstream out{config.emit_};
+        for(std::uint64_t i = 0; i < config.prefill_; ++i)
+            WriteCommand(out, flow.NextPassive());
+        for(std::uint64_t i = 0; i < config.ops_; ++i)
+            WriteCommand(out, flow.Next());
+        return out ? 0 : 1;
+    }
+
+    OrderbookConfig bookConfig;
+    bookConfig.pruneThread_ = false;
+    bookConfig.orderCapacity_ = config.prefill_ + config.ops_ / 4;
+    Orderbook orderbook{bookConfig};
+
+    for(std::uint64_t i = 0; i < config.prefill_; ++i)
+        orderbook.Apply(flow.NextPassive());
+    Instrumentation::Reset(); // only the timed loop
+
+    // generate up front so the timed loop only measures the book
+    std::vector<Command> commands;
+    commands.reserve(config.ops_);
+    for(std::uint64_t i = 0; i < config.ops_; ++i)
+        commands.push_back(flow.Next());
+
+    using Clock = std::chrono::steady_clock;
+    std::array<LatencyHistogram, 3> histograms; // add, cancel, modify
+
+    // fills are only counted, the book reports them through a sink so nothing is allocated for them
+    std::uint64_t fills = 0;
+    auto CountFill = [&fills](const Trade&){ ++fills; };
+
+    const auto start = Clock::now();
+    for(const auto& command : commands){
+        const auto before = Clock::now();
+        orderbook.Apply(command, CountFill);
+        const auto after = Clock::now();
+        histograms[static_cast<std::size_t>(command.type_)].Record(
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count()));
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    const auto& mix = config.flow_.actionMix_;
+    const auto& types = config.flow_.typeMix_;
+    std::printf("ops %llu, prefill %llu, seed %llu, mid %d, levels %d, cross %u%%\n",
+                static_cast<unsigned long long>(config.ops_), static_cast<unsigned long long>(config.prefill_),
+                static_cast<unsigned long long>(config.flow_.seed_), config.flow_.mid_, config.flow_.levels_,
+                config.flow_.crossPercent_);
+    std::printf("mix add/cancel/modify %u/%u/%u, types gtc/fak/fok/gfd/mkt %u/%u/%u/%u/%u\n",
+                mix[0], mix[1], mix[2], types[0], types[1], types[2], types[3], types[4]);
+    std::printf("throughput %.0f ops/s over %.3f s, %llu fills, %zu orders resting at the end\n\n",
+                static_cast<double>(config.ops_) / seconds, seconds, static_cast<unsigned long long>(fills), orderbook.Size());
+
+    std::printf("%-8s %10s %9s %8s %8s %8s %10s  (ns)\n", "op", "count", "mean", "p50", "p99", "p99.9", "max");
+    PrintRow("add", histograms[0]);
+    PrintRow("cancel", histograms[1]);
+    PrintRow("modify", histograms[2]);
+
+    if constexpr(Instrumentation::Enabled){
+        std::printf("\nadd path by stage\n");
+        std::fflush(stdout);
+        Instrumentation::WriteText(std::cout);
+        if(!config.stages_.empty()){
+            std::ofstream out{config.stages_};
+            Instrumentation::WriteCsv(out);
+        }
+    }
+    else if(!config.stages_.empty()){
+        std::cerr << "--stages needs a build with INSTRUMENT=1\n";
+    }
+    return 0;
+}
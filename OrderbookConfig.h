@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include "OrderPool.h"
+#include "PreTradeRisk.h"
+#include "Usings.h"
+
+/* Knobs picked when the orderbook is created */
+
+struct OrderbookConfig {
+    // resting orders the pool holds before it has to grow
+    std::size_t orderCapacity_ = OrderPool::DefaultSlabSize;
+
+    // price ladder window per side, 0 keeps every level in an ordered map
+    std::size_t ladderLevels_ = 4096;
+    Price tickSize_ = 1;
+    // lowest price of the window, unset means centre it on the first order of each side
+    // either way an empty side re-centres on an order priced outside its window
+    std::optional<Price> basePrice_;
+
+    // background thread that cancels GoodForDay orders at the close and GoodTillTime orders
+    // at their deadline, turn it off when a single owner thread drives the book and expires it itself
+    bool pruneThread_ = true;
+    // local time of day the session closes at
+    std::chrono::seconds sessionClose_ = std::chrono::hours(16);
+    // orders expired per lock, matching gets the book back in between, 0 = all at once
+    std::size_t expiryBatch_ = 256;
+
+    // keep a LevelUpdate for every level change until DrainLevelUpdates collects them
+    // off by default, nobody draining means the buffer only grows
+    bool levelUpdates_ = false;
+
+    // publish every level for ReadDepth / GetOrderInfos at the end of each call that changed one
+    // rebuilding it costs the levels in the book, feed the book through ApplyBatch to pay it once per batch
+    bool depthSnapshots_ = false;
+
+    // per account limits, price bands and max order size checked before an order gets in
+    RiskConfig risk_;
+};
@@ -0,0 +1,304 @@
+#include "../Orderbook.h"
+#include "../CommandParser.h"
+#include "../Journal.h"
+#include "../LatencyHistogram.h"
+#include "../MappedFile.h"
+#include "../TradeTapeHash.h"
+
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Streaming command driver */
+/*
+ * pushes a recorded session through one book as fast as it can be read
+ *
+ *   ./orderbook_driver_bin [--batch=N] [--trades=FILE|-] [--journal=FILE] [--latency] [INPUT|-]
+ *
+ * INPUT is the A / M / C / P text format (see CommandParser.h) or a binary journal (see Journal.h),
+ * told apart by the journal header; files are mapped, stdin (- or no INPUT) is read in chunks
+ * commands are parsed a batch at a time and then applied, trades go to --trades one per line
+ *
+ *   T <bidOrderId> <bidPrice> <askOrderId> <askPrice> <quantity>
+ *
+ * the summary on stderr has the message rate and a hash of the trade tape, the same input gives
+ * the same hash on any build that matches the same way, so two builds (or data structures) can be
+ * checked for bit for bit equal trading on a recorded session without keeping the tapes around
+ * --latency also times every command and prints p50/p99/p99.9/max per command type
+ */
+
+namespace {
+
+struct DriverConfig {
+    std::string input_ = "-";
+    std::string trades_;
+    std::string journal_;
+    std::size_t batch_ = 1024;
+    bool latency_ = false;
+};
+
+bool ParseArguments(int argc, char** argv, DriverConfig& config)
+{
+    bool haveInput = false;
+    for(int i = 1; i < argc; ++i){
+        const std::string_view argument{argv[i]};
+        if(argument.substr(0, 2) != "--"){
+            if(haveInput)
+                return false;
+            config.input_ = argument;
+            haveInput = true;
+            continue;
+        }
+
+        if(argument == "--latency"){
+            config.latency_ = true;
+            continue;
+        }
+
+        const auto equals = argument.find('=');
+        if(equals == std::string_view::npos)
+            return false;
+        const auto key = argument.substr(2, equals - 2);
+        const auto value = argument.substr(equals + 1);
+        if(key == "batch"){
+            const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), config.batch_);
+            if(error != std::errc{} || end != value.data() + value.size() || config.batch_ == 0)
+                return false;
+        }
+        else if(key == "trades") config.trades_ = value;
+        else if(key == "journal") config.journal_ = value;
+        else return false;
+    }
+    return true;
+}
+
+/* trades formatted straight into a big buffer, one fwrite when it fills up */
+class TradeWriter {
+public:
+    explicit TradeWriter(std::FILE* out)
+    : out_{out}, buffer_(out == nullptr ? 0 : BufferSize)
+    {}
+    ~TradeWriter(){ Flush(); }
+
+    void Write(const Trade& trade){
+        if(out_ == nullptr)
+            return;
+        if(buffer_.size() - used_ < MaxLine)
+            Flush();
+
+        char* cursor = buffer_.data() + used_;
+        char* const end = buffer_.data() + buffer_.size();
+        *cursor++ = 'T';
+        cursor = Field(cursor, end, trade.GetBidTrade().orderId_);
+        cursor = Field(cursor, end, trade.GetBidTrade().price_);
+        cursor = Field(cursor, end, trade.GetAskTrade().orderId_);
+        cursor = Field(cursor, end, trade.GetAskTrade().price_);
+        cursor = Field(cursor, end, trade.GetBidTrade().quantity_);
+        *cursor++ = '\n';
+        used_ = static_cast<std::size_t>(cursor - buffer_.data());
+    }
+
+    void Flush(){
+        if(used_ > 0)
+            std::fwrite(buffer_.data(), 1, used_, out_);
+        used_ = 0;
+    }
+
+private:
+    static constexpr std::size_t BufferSize = 1 << 16;
+    static constexpr std::size_t MaxLine = 128; // 5 numbers of at most 20 digits and separators
+
+    template<typename T>
+    static char* Field(char* cursor, char* end, T value){
+        *cursor++ = ' ';
+        return std::to_chars(cursor, end, value).ptr;
+    }
+
+    std::FILE* out_;
+    std::vector<char> buffer_;
+    std::size_t used_{0};
+};
+
+/* what a chunk of text left unparsed, and the line it starts on */
+struct Leftover {
+    std::string_view text_;
+    std::size_t line_;
+};
+
+class Driver {
+public:
+    Driver(SingleThreadedOrderbook& orderbook, TradeWriter& trades, std::size_t batchSize, bool timed)
+    : orderbook_{orderbook}, trades_{trades}, timed_{timed}
+    {
+        batch_.reserve(batchSize);
+    }
+
+    void Push(const Command& command){
+        batch_.push_back(command);
+        if(batch_.size() == batch_.capacity())
+            Flush();
+    }
+
+    void Flush(){
+        auto Write = [this](const Trade& trade){
+            trades_.Write(trade);
+            tape_.Add(trade);
+        };
+        if(timed_){
+            using Clock = std::chrono::steady_clock;
+            for(const auto& command : batch_){
+                const auto before = Clock::now();
+                orderbook_.Apply(command, Write);
+                const auto after = Clock::now();
+                latencies_[static_cast<std::size_t>(command.type_)].Record(
+                    static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count()));
+            }
+        }
+        else{
+            orderbook_.ApplyBatch(batch_, Write);
+        }
+        commands_ += batch_.size();
+        batch_.clear();
+    }
+
+    /* text from a buffer, see CommandParser for what complete means */
+    Leftover Text(std::string_view text, bool complete, std::size_t line){
+        CommandParser parser{text, complete, line};
+        Command command;
+        while(parser.Next(command))
+            Push(command);
+        return {parser.Rest(), parser.Line()};
+    }
+
+    std::uint64_t Commands() const {return commands_;}
+    const TradeTapeHash& Tape() const {return tape_;}
+
+    /* one row per command type that showed up, in ns */
+    void PrintLatencies(std::FILE* out) const {
+        static constexpr const char* Names[] = {"add", "cancel", "modify", "prune", "expire", "auction", "uncross", "limits"};
+        std::fprintf(out, "%-8s %10s %9s %8s %8s %8s %10s  (ns)\n", "command", "count", "mean", "p50", "p99", "p99.9", "max");
+        for(std::size_t i = 0; i < latencies_.size(); ++i){
+            const LatencyHistogram& histogram = latencies_[i];
+            if(histogram.Count() == 0)
+                continue;
+            std::fprintf(out, "%-8s %10llu %9.1f %8llu %8llu %8llu %10llu\n", Names[i],
+                         static_cast<unsigned long long>(histogram.Count()), histogram.Mean(),
+                         static_cast<unsigned long long>(histogram.Percentile(50)),
+                         static_cast<unsigned long long>(histogram.Percentile(99)),
+                         static_cast<unsigned long long>(histogram.Percentile(99.9)),
+                         static_cast<unsigned long long>(histogram.Max()));
+        }
+    }
+
+private:
+    SingleThreadedOrderbook& orderbook_;
+    TradeWriter& trades_;
+    bool timed_;
+    std::vector<Command> batch_;
+    std::uint64_t commands_{0};
+    TradeTapeHash tape_;
+    std::array<LatencyHistogram, 8> latencies_; // by CommandType
+};
+
+/* stdin cannot be mapped, read it in chunks and carry a partial last line over */
+void DriveStream(std::FILE* in, Driver& driver)
+{
+    std::vector<char> buffer(1 << 20);
+    std::size_t carried = 0;
+    std::size_t line = 1;
+    while(true){
+        const std::size_t read = std::fread(buffer.data() + carried, 1, buffer.size() - carried, in);
+        const bool complete = read == 0;
+        const auto rest = driver.Text({buffer.data(), carried + read}, complete, line);
+        if(complete)
+            break;
+
+        line = rest.line_;
+        carried = rest.text_.size();
+        std::memmove(buffer.data(), rest.text_.data(), carried);
+        if(carried == buffer.size()) // a line longer than the buffer, make room
+            buffer.resize(buffer.size() * 2);
+    }
+}
+
+void DriveFile(const std::string& path, Driver& driver)
+{
+    MappedFile file{path};
+    if(!JournalReader::IsJournal(file.View())){
+        driver.Text(file.View(), true, 1);
+        return;
+    }
+
+    JournalReader journal{path};
+    for(const auto& record : journal)
+        driver.Push(record.ToCommand());
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    DriverConfig config;
+    if(!ParseArguments(argc, argv, config)){
+        std::cerr << "usage: " << argv[0] << " [--batch=N] [--trades=FILE|-] [--journal=FILE] [--latency] [INPUT|-]\n";
+        return 1;
+    }
+
+    try{
+        std::unique_ptr<std::FILE, int(*)(std::FILE*)> tradesFile{nullptr, &std::fclose};
+        std::FILE* tradesOut = nullptr;
+        if(config.trades_ == "-")
+            tradesOut = stdout;
+        else if(!config.trades_.empty()){
+            tradesFile.reset(std::fopen(config.trades_.c_str(), "wb"));
+            if(!tradesFile)
+                throw std::runtime_error("cannot open " + config.trades_);
+            tradesOut = tradesFile.get();
+        }
+
+        OrderbookConfig bookConfig;
+        // one thread drives it and the input says when the close is, with P and E
+        SingleThreadedOrderbook orderbook{bookConfig};
+
+        std::unique_ptr<JournalWriter> journal;
+        if(!config.journal_.empty()){
+            journal = std::make_unique<JournalWriter>(JournalConfig{config.journal_});
+            orderbook.AttachJournal(journal.get());
+        }
+
+        TradeWriter trades{tradesOut};
+        Driver driver{orderbook, trades, config.batch_, config.latency_};
+
+        const auto start = std::chrono::steady_clock::now();
+        if(config.input_ == "-")
+            DriveStream(stdin, driver);
+        else
+            DriveFile(config.input_, driver);
+        driver.Flush();
+        trades.Flush();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        orderbook.AttachJournal(nullptr);
+        std::fprintf(stderr, "%llu commands in %.3f s (%.0f per second), %zu orders resting\n",
+                     static_cast<unsigned long long>(driver.Commands()), seconds,
+                     seconds > 0 ? static_cast<double>(driver.Commands()) / seconds : 0.0, orderbook.Size());
+        std::fprintf(stderr, "%llu trades, tape hash %016llx\n",
+                     static_cast<unsigned long long>(driver.Tape().Trades()),
+                     static_cast<unsigned long long>(driver.Tape().Value()));
+        if(config.latency_)
+            driver.PrintLatencies(stderr);
+    }
+    catch(const std::exception& error){
+        std::cerr << argv[0] << ": " << error.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <mutex>
+#include "FlatOrderIndex.h"
+#include "PriceLadder.h"
+#include "Side.h"
+#include "Usings.h"
+
+/* Compile time choices for an Orderbook (see BasicOrderbook in Orderbook.h) */
+/*
+ * a policy names
+ *   Levels<Side>        one side of the book, needs what PriceLadder offers
+ *   OrderIndex<Entry>   order id -> Entry, needs find / contains / emplace / erase / reserve / size / empty
+ *                       (FlatOrderIndex or a std::unordered_map)
+ *   Mutex               what guards the book
+ *   ExpiryThread        whether the book can run its own GoodForDay / GoodTillTime expiry thread
+ *
+ * the default is the shared book everything used to get, anything else is picked per build so none of it
+ * costs a virtual call or a branch on the hot path
+ */
+
+/* for books only one thread ever touches, locking it compiles away */
+struct NullMutex {
+    void lock() {}
+    void unlock() {}
+    bool try_lock() {return true;}
+};
+
+/* shared between the caller and the expiry thread, safe to call from anywhere */
+struct DefaultOrderbookPolicy {
+    template<Side S>
+    using Levels = PriceLadder<S>;
+    template<typename Entry>
+    using OrderIndex = FlatOrderIndex<Entry>;
+    using Mutex = std::mutex;
+    static constexpr bool ExpiryThread = true;
+};
+
+/* owned by one thread (a matching engine, a replay), which also calls ExpireOrders itself */
+struct SingleThreadedOrderbookPolicy {
+    template<Side S>
+    using Levels = PriceLadder<S>;
+    template<typename Entry>
+    using OrderIndex = FlatOrderIndex<Entry>;
+    using Mutex = NullMutex;
+    static constexpr bool ExpiryThread = false;
+};
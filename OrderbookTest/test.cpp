@@ -1,11 +1,30 @@
 #include "../Orderbook.h"
+#include "../MatchingEngine.h"
+#include "../Exchange.h"
+#include "../Instrumentation.h"
+#include "../LatencyHistogram.h"
+#include "../Journal.h"
+#include "../CommandParser.h"
+#include "../TradeTapeHash.h"
+#include "../EpochPublisher.h"
+#include "../FlatOrderIndex.h"
+#include "../OrderbookBench/OrderFlow.h"
 #include <gtest/gtest.h>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <map>
+#include <atomic>
+#include <random>
+#include <span>
+#include <sstream>
 #include <string>
 #include <string_view>
 #include <vector>
 #include <tuple>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 
 enum class ActionType {
     Add,
@@ -164,8 +183,6 @@ TEST_P(OrderbookTestsFixture, OrderbookTestSuite) {
     InputHandler handler;
     auto [updates, result] = handler.GetInformations(file);
 
-    Orderbook orderbook;
-
     auto GetOrder = [](const Information& info) {
         return std::make_shared<Order>(
             info.orderType_,
@@ -185,24 +202,1572 @@ TEST_P(OrderbookTestsFixture, OrderbookTestSuite) {
         };
     };
 
-    for (const auto& update : updates) {
-        switch (update.type_) {
-            case ActionType::Add:
-                orderbook.AddOrder(GetOrder(update));
-                break;
-            case ActionType::Modify:
-                orderbook.ModifyOrder(GetOrderModify(update));
-                break;
-            case ActionType::Cancel:
-                orderbook.CancelOrder(update.orderId_);
-                break;
+    // every scenario runs on the default ladder, a tiny ladder that spills into the
+    // overflow map, and a pure map book
+    auto WithLadder = [](std::size_t levels) {
+        OrderbookConfig config;
+        config.ladderLevels_ = levels;
+        return config;
+    };
+    const OrderbookConfig configs[] = { OrderbookConfig{}, WithLadder(4), WithLadder(0) };
+
+    for (const auto& config : configs) {
+        Orderbook orderbook{config};
+
+        for (const auto& update : updates) {
+            switch (update.type_) {
+                case ActionType::Add:
+                    orderbook.AddOrder(GetOrder(update));
+                    break;
+                case ActionType::Modify:
+                    orderbook.ModifyOrder(GetOrderModify(update));
+                    break;
+                case ActionType::Cancel:
+                    orderbook.CancelOrder(update.orderId_);
+                    break;
+            }
+        }
+
+        const auto& infos = orderbook.GetOrderInfos();
+        ASSERT_EQ(orderbook.Size(), result.allCount_);
+        ASSERT_EQ(infos.GetBids().size(), result.bidCount_);
+        ASSERT_EQ(infos.GetAsks().size(), result.askCount_);
+    }
+}
+
+TEST(PriceLadderTests, LevelsComeOutBestFirstAcrossWindowAndOverflow) {
+    PriceLadder<Side::Buy> bids{4, 1, 100}; // window is 100..103
+    for (Price price : {101, 99, 105, 100, 103, 90})
+        bids.GetOrCreate(price);
+
+    std::vector<Price> prices;
+    bids.ForEachLevel([&](Price price, const OrderQueue&) { prices.push_back(price); });
+    ASSERT_EQ(prices, (std::vector<Price>{105, 103, 101, 100, 99, 90}));
+    ASSERT_EQ(bids.Size(), 6u);
+    ASSERT_EQ(bids.BestPrice(), 105);
+    ASSERT_EQ(bids.WorstPrice(), 90);
+
+    bids.Erase(105);
+    ASSERT_EQ(bids.BestPrice(), 103);
+    bids.Erase(103);
+    ASSERT_EQ(bids.BestPrice(), 101);
+    bids.Erase(90);
+    ASSERT_EQ(bids.WorstPrice(), 99);
+}
+
+TEST(PriceLadderTests, EmptySideRecentresOnNextPrice) {
+    PriceLadder<Side::Sell> asks{8, 1, 0};
+    asks.GetOrCreate(1000);
+    asks.GetOrCreate(1002);
+    asks.GetOrCreate(998);
+    ASSERT_EQ(asks.BestPrice(), 998);
+    ASSERT_EQ(asks.WorstPrice(), 1002);
+}
+
+TEST(PriceLadderTests, WithoutABasePriceTheWindowCentresOnTheFirstLevel) {
+    PriceLadder<Side::Buy> bids{8, 1, std::nullopt};
+    bids.GetOrCreate(3); // window is -1..6, not 0..7
+    bids.GetOrCreate(-1);
+    bids.GetOrCreate(6);
+    ASSERT_EQ(bids.OverflowSize(), 0u);
+    bids.GetOrCreate(7);
+    ASSERT_EQ(bids.OverflowSize(), 1u);
+    ASSERT_EQ(bids.BestPrice(), 7);
+    ASSERT_EQ(bids.WorstPrice(), -1);
+}
+
+TEST(PriceLadderTests, DepthCountsOnlyLevelsAtLimitOrBetter) {
+    PriceLadder<Side::Buy> bids{4, 1, 100}; // window is 100..103, 99 and 105 overflow
+    for (auto [price, quantity] : {std::pair{105, 3u}, {103, 4u}, {101, 5u}, {99, 6u}}) {
+        bids.GetOrCreate(price);
+        bids.UpdateLevelData(price, quantity, LevelData::Action::ADD);
+    }
+
+    ASSERT_TRUE(bids.HasDepth(101, 12));
+    ASSERT_FALSE(bids.HasDepth(101, 13));
+    ASSERT_TRUE(bids.HasDepth(99, 18));
+    ASSERT_FALSE(bids.HasDepth(106, 1));
+
+    bids.UpdateLevelData(103, 4, LevelData::Action::MATCH);
+    ASSERT_FALSE(bids.HasDepth(101, 12));
+    ASSERT_EQ(bids.Data(103).count_, 1u);
+    ASSERT_EQ(bids.Data(103).quantity_, 0u);
+}
+
+TEST(SpscQueueTests, WrapsAroundAndReportsFull) {
+    SpscQueue<int> queue{3}; // rounded up to 4
+    ASSERT_EQ(queue.Capacity(), 4u);
+
+    int value{};
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 4; ++i)
+            ASSERT_TRUE(queue.TryPush(round * 10 + i));
+        ASSERT_FALSE(queue.TryPush(99));
+        for (int i = 0; i < 4; ++i) {
+            ASSERT_TRUE(queue.TryPop(value));
+            ASSERT_EQ(value, round * 10 + i);
+        }
+        ASSERT_FALSE(queue.TryPop(value));
+    }
+}
+
+TEST(MatchingEngineTests, EveryCommandIsClosedByOneFinalReport) {
+    MatchingEngine engine;
+    engine.AddInstrument(0);
+    auto& session = engine.OpenSession();
+    engine.Start();
+
+    ASSERT_TRUE(session.TrySubmit(Command::Add(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10})));
+    ASSERT_TRUE(session.TrySubmit(Command::Add(Order{OrderType::GoodTillCancel, 2, Side::Sell, 100, 4})));
+    ASSERT_TRUE(session.TrySubmit(Command::Add(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10})));
+    ASSERT_TRUE(session.TrySubmit(Command::Add(Order{OrderType::FillAndKill, 3, Side::Buy, 100, 10})));
+    ASSERT_TRUE(session.TrySubmit(Command::Cancel(42)));
+    ASSERT_TRUE(session.TrySubmit(Command::Cancel(1)));
+    ASSERT_TRUE(session.TrySubmit(Command::Cancel(1, 7)));
+
+    std::vector<ExecutionReport> reports;
+    ExecutionReport report;
+    while (reports.size() < 8) {
+        if (session.TryPoll(report))
+            reports.push_back(report);
+    }
+    engine.Stop();
+
+    ASSERT_EQ(reports[0].type_, ReportType::Accepted);
+    ASSERT_EQ(reports[1].type_, ReportType::Trade);
+    ASSERT_EQ(reports[1].bidTrade_.orderId_, 1u);
+    ASSERT_EQ(reports[1].askTrade_.quantity_, 4u);
+    ASSERT_EQ(reports[2].type_, ReportType::Accepted);
+    ASSERT_EQ(reports[3].reason_, RejectReason::DuplicateOrderId);
+    ASSERT_EQ(reports[4].reason_, RejectReason::NoLiquidity);
+    ASSERT_EQ(reports[5].reason_, RejectReason::UnknownOrder);
+    ASSERT_EQ(reports[6].type_, ReportType::Cancelled);
+    ASSERT_EQ(reports[7].reason_, RejectReason::UnknownInstrument);
+    ASSERT_EQ(engine.Book().Size(), 0u);
+    ASSERT_EQ(engine.Stats().commands_, 7u);
+    ASSERT_EQ(engine.Stats().rejects_, 4u);
+}
+
+TEST(MatchingEngineTests, AnAmendToNothingIsReportedAsACancel) {
+    MatchingEngine engine;
+    engine.AddInstrument(0);
+    auto& session = engine.OpenSession();
+    engine.Start();
+
+    ASSERT_TRUE(session.TrySubmit(Command::Add(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10})));
+    ASSERT_TRUE(session.TrySubmit(Command::Modify(OrderModify{1, Side::Buy, 100, 0})));
+    ASSERT_TRUE(session.TrySubmit(Command::Modify(OrderModify{1, Side::Buy, 100, 0}))); // gone by now
+
+    std::vector<ExecutionReport> reports;
+    ExecutionReport report;
+    while (reports.size() < 3) {
+        if (session.TryPoll(report))
+            reports.push_back(report);
+    }
+    engine.Stop();
+
+    ASSERT_EQ(reports[0].type_, ReportType::Accepted);
+    ASSERT_EQ(reports[1].type_, ReportType::Cancelled);
+    ASSERT_EQ(reports[1].reason_, RejectReason::None);
+    ASSERT_EQ(reports[2].type_, ReportType::Rejected);
+    ASSERT_EQ(reports[2].reason_, RejectReason::UnknownOrder);
+    ASSERT_EQ(engine.Book().Size(), 0u);
+    ASSERT_EQ(engine.Stats().rejects_, 1u);
+}
+
+TEST(MatchingEngineTests, AnIcebergTheBookCannotTakeIsRejectedNotThrown) {
+    MatchingEngine engine;
+    engine.AddInstrument(0);
+    auto& session = engine.OpenSession();
+    engine.Start();
+
+    Command fillAndKill = Command::Add(Order{OrderType::FillAndKill, 1, Side::Buy, 100, 10});
+    fillAndKill.peak_ = 5;
+    Command goodTillTime = Command::Add(Order{OrderType::GoodTillTime, 2, Side::Buy, 100, 10, Timestamp{1000}});
+    goodTillTime.peak_ = 5;
+    ASSERT_TRUE(session.TrySubmit(fillAndKill));
+    ASSERT_TRUE(session.TrySubmit(goodTillTime));
+    // the matching thread is still there to take a good one
+    ASSERT_TRUE(session.TrySubmit(Command::Add(Order::Iceberg(OrderType::GoodTillCancel, 3, Side::Buy, 100, 10, 5))));
+
+    std::vector<ExecutionReport> reports;
+    ExecutionReport report;
+    while (reports.size() < 3) {
+        if (session.TryPoll(report))
+            reports.push_back(report);
+    }
+    engine.Stop();
+
+    ASSERT_EQ(reports[0].type_, ReportType::Rejected);
+    ASSERT_EQ(reports[0].reason_, RejectReason::InvalidIceberg);
+    ASSERT_EQ(reports[1].type_, ReportType::Rejected);
+    ASSERT_EQ(reports[1].reason_, RejectReason::InvalidIceberg);
+    ASSERT_EQ(reports[2].type_, ReportType::Accepted);
+    ASSERT_EQ(engine.Book().Size(), 1u);
+    ASSERT_EQ(engine.Stats().rejects_, 2u);
+}
+
+TEST(MatchingEngineTests, ProducersOnSeparateThreadsShareOneBook) {
+    MatchingEngine engine;
+    engine.AddInstrument(0);
+    auto& buyer = engine.OpenSession();
+    auto& seller = engine.OpenSession();
+    engine.Start();
+
+    constexpr OrderId Orders = 500;
+    std::size_t buyerTrades = 0, sellerTrades = 0;
+    std::thread buys{[&] {
+        for (OrderId id = 1; id <= Orders; ++id)
+            buyerTrades += buyer.AddOrder(Order{OrderType::GoodTillCancel, id, Side::Buy, 100, 10}).size();
+    }};
+    std::thread sells{[&] {
+        for (OrderId id = Orders + 1; id <= 2 * Orders; ++id)
+            sellerTrades += seller.AddOrder(Order{OrderType::GoodTillCancel, id, Side::Sell, 100, 10}).size();
+    }};
+    buys.join();
+    sells.join();
+    engine.Stop();
+
+    ASSERT_EQ(buyerTrades + sellerTrades, Orders);
+    ASSERT_EQ(engine.Book().Size(), 0u);
+}
+
+TEST(ExchangeTests, CommandsAreRoutedToTheShardOwningTheInstrument) {
+    ExchangeConfig config;
+    config.shards_ = 3;
+    Exchange exchange{config};
+    for (InstrumentId instrument = 0; instrument < 30; ++instrument)
+        exchange.AddInstrument(instrument);
+    exchange.AddInstrument(99, 2);
+    ASSERT_EQ(exchange.ShardOf(99), 2u);
+    ASSERT_FALSE(exchange.ShardOf(100).has_value());
+
+    auto& first = exchange.OpenSession();
+    auto& second = exchange.OpenSession();
+    exchange.Start();
+
+    // same order ids on every instrument, books are independent
+    auto Trade = [](Exchange::Session& session, InstrumentId instrument, Side side) {
+        return session.AddOrder(instrument, Order{OrderType::GoodTillCancel, side == Side::Buy ? 1u : 2u, side, 100, 10}).size();
+    };
+    std::size_t trades = 0;
+    std::thread buys{[&] { for (InstrumentId i = 0; i < 30; ++i) Trade(first, i, Side::Buy); }};
+    buys.join();
+    for (InstrumentId i = 0; i < 30; ++i)
+        trades += Trade(second, i, Side::Sell);
+    ASSERT_EQ(first.AddOrder(99, Order{OrderType::GoodForDay, 1, Side::Buy, 100, 10}).size(), 0u);
+    ASSERT_TRUE(first.AddOrder(100, Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10}).empty());
+    first.PruneGoodForDay();
+    exchange.Stop();
+
+    ASSERT_EQ(trades, 30u);
+    ASSERT_EQ(exchange.Book(99).Size(), 0u);
+
+    std::uint64_t commands = 0;
+    for (const auto& shard : exchange.Stats()) {
+        ASSERT_GE(shard.instruments_, 10u);
+        commands += shard.commands_;
+    }
+    ASSERT_EQ(commands, 61u + exchange.ShardCount());
+}
+
+TEST(LatencyHistogramTests, PercentilesStayWithinBucketPrecision) {
+    LatencyHistogram histogram;
+    for (std::uint64_t value = 1; value <= 10000; ++value)
+        histogram.Record(value);
+
+    ASSERT_EQ(histogram.Count(), 10000u);
+    ASSERT_EQ(histogram.Min(), 1u);
+    ASSERT_EQ(histogram.Max(), 10000u);
+    ASSERT_NEAR(static_cast<double>(histogram.Percentile(50)), 5000.0, 5000 * 0.016);
+    ASSERT_NEAR(static_cast<double>(histogram.Percentile(99)), 9900.0, 9900 * 0.016);
+    ASSERT_EQ(histogram.Percentile(100), 10000u);
+
+    LatencyHistogram other;
+    other.Record(1u << 20);
+    histogram.Merge(other);
+    ASSERT_EQ(histogram.Max(), 1u << 20);
+    ASSERT_EQ(histogram.Percentile(100), 1u << 20);
+}
+
+TEST(InstrumentationTests, AddPathStagesAreCountedOnlyWhenBuiltIn) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook orderbook{config};
+    Instrumentation::Reset();
+
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Sell, 100, 10});
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 100, 4});
+    orderbook.AddOrder(Order{OrderType::FillAndKill, 3, Side::Buy, 90, 4}); // nothing to match, stops at admission
+
+    // exited threads keep their counts
+    std::thread{[&] { orderbook.AddOrder(Order{OrderType::GoodTillCancel, 4, Side::Buy, 95, 1}); }}.join();
+
+    const StageLatencies latencies = Instrumentation::Collect();
+    const std::uint64_t expected = Instrumentation::Enabled ? 4 : 0;
+    ASSERT_EQ(latencies.Of(HotPathStage::Lock).Count(), expected);
+    ASSERT_EQ(latencies.Of(HotPathStage::Admission).Count(), expected);
+    ASSERT_EQ(latencies.Of(HotPathStage::Match).Count(), Instrumentation::Enabled ? 3u : 0u);
+
+    std::ostringstream csv;
+    Instrumentation::WriteCsv(csv);
+    ASSERT_EQ(csv.str().rfind("stage,count,", 0), 0u);
+    ASSERT_NE(csv.str().find("\nmatch,"), std::string::npos);
+}
+TEST(JournalTests, ReplayRebuildsTheSameBook) {
+    const auto path = std::filesystem::temp_directory_path() / "orderbook_journal_test.bin";
+    std::filesystem::remove(path);
+
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.expiryBatch_ = 3;
+    OrderFlowConfig flowConfig;
+    flowConfig.typeMix_ = {70, 10, 5, 10, 5};
+    OrderFlow flow{flowConfig};
+
+    Orderbook live{config};
+    std::uint64_t journaled = 0;
+    {
+        JournalWriter journal{JournalConfig{path.string(), 64, FsyncPolicy::Never, {}}};
+        live.AttachJournal(&journal);
+        for (int i = 0; i < 20000; ++i) {
+            live.Apply(flow.Next());
+            if (i == 10000)
+                live.CancelGoodForDayOrders();
+            if (i % 100 == 0) // timed orders, expired in batches of expiryBatch_
+                live.AddOrder(Order{OrderType::GoodTillTime, 1'000'000u + i, Side::Buy, 9990 - i % 7, 5, i});
+            if (i % 1000 == 999)
+                live.ExpireOrders(i);
+        }
+        live.AttachJournal(nullptr);
+        journaled = journal.NextSequence();
+    }
+    ASSERT_GT(journaled, 0u);
+
+    Orderbook replayed{config};
+    ASSERT_EQ(ReplayJournal(path.string(), replayed), journaled);
+
+    auto Levels = [](const LevelInfos& infos) {
+        std::vector<std::pair<Price, Quantity>> levels;
+        for (const auto& info : infos)
+            levels.emplace_back(info.price_, info.quantity_);
+        return levels;
+    };
+    const auto expected = live.GetOrderInfos();
+    const auto actual = replayed.GetOrderInfos();
+    ASSERT_EQ(replayed.Size(), live.Size());
+    ASSERT_EQ(Levels(actual.GetBids()), Levels(expected.GetBids()));
+    ASSERT_EQ(Levels(actual.GetAsks()), Levels(expected.GetAsks()));
+
+    // reopening carries on the numbering
+    JournalWriter reopened{JournalConfig{path.string(), 64, FsyncPolicy::EveryBatch, {}}};
+    ASSERT_EQ(reopened.NextSequence(), journaled);
+    std::filesystem::remove(path);
+}
+
+TEST(JournalTests, ATornLastRecordIsCutOffBeforeAppending) {
+    const auto path = std::filesystem::temp_directory_path() / "orderbook_journal_torn_test.bin";
+    std::filesystem::remove(path);
+    {
+        JournalWriter journal{JournalConfig{path.string(), 64, FsyncPolicy::Never, {}}};
+        journal.Append(Command::Add(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10}));
+        journal.Append(Command::Add(Order{OrderType::GoodTillCancel, 2, Side::Buy, 101, 20}));
+    }
+    // a crash in the middle of writing record 2
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 10);
+    {
+        JournalWriter journal{JournalConfig{path.string(), 64, FsyncPolicy::Never, {}}};
+        ASSERT_EQ(journal.NextSequence(), 1u);
+        journal.Append(Command::Add(Order{OrderType::GoodTillCancel, 3, Side::Buy, 102, 30}));
+        journal.Append(Command::Add(Order{OrderType::GoodTillCancel, 4, Side::Buy, 103, 40}));
+    }
+
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook replayed{config};
+    ASSERT_EQ(ReplayJournal(path.string(), replayed), 3u);
+    ASSERT_EQ(replayed.Size(), 3u);
+    ASSERT_TRUE(replayed.Contains(1));
+    ASSERT_FALSE(replayed.Contains(2));
+    ASSERT_TRUE(replayed.Contains(3));
+    ASSERT_TRUE(replayed.Contains(4));
+    const auto bids = replayed.GetOrderInfos().GetBids();
+    ASSERT_EQ(bids.size(), 3u);
+    ASSERT_EQ(bids[0].price_, 103);
+    ASSERT_EQ(bids[0].quantity_, 40u);
+
+    // not a journal, nothing gets appended to it
+    {
+        std::ofstream out{path, std::ios::binary | std::ios::trunc};
+        out << "this is not a journal at all, just text";
+    }
+    auto OpenDescriptors = [] {
+        return std::distance(std::filesystem::directory_iterator{"/proc/self/fd"}, std::filesystem::directory_iterator{});
+    };
+    const auto open = OpenDescriptors();
+    ASSERT_THROW((JournalWriter{JournalConfig{path.string(), 64, FsyncPolicy::Never, {}}}), std::runtime_error);
+    // opens fine but the header cannot be written
+    ASSERT_THROW((JournalWriter{JournalConfig{"/dev/full", 64, FsyncPolicy::Never, {}}}), std::runtime_error);
+    ASSERT_EQ(OpenDescriptors(), open); // a writer that failed to open keeps no descriptor
+    std::filesystem::remove(path);
+}
+
+TEST(SnapshotTests, SnapshotPlusJournalTailRecoversTheBook) {
+    const auto directory = std::filesystem::temp_directory_path();
+    const auto journalPath = directory / "orderbook_snapshot_test.journal";
+    const auto snapshotPath = directory / "orderbook_snapshot_test.snapshot";
+    std::filesystem::remove(journalPath);
+
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    OrderFlow flow{OrderFlowConfig{}};
+
+    Orderbook live{config};
+    std::uint64_t snapshotSequence = 0;
+    {
+        JournalWriter journal{JournalConfig{journalPath.string(), 64, FsyncPolicy::Never, {}}};
+        live.AttachJournal(&journal);
+        for (int i = 0; i < 10000; ++i)
+            live.Apply(flow.Next());
+        snapshotSequence = live.SaveSnapshot(snapshotPath.string());
+        for (int i = 0; i < 5000; ++i)
+            live.Apply(flow.Next());
+        live.AttachJournal(nullptr);
+    }
+    ASSERT_GT(snapshotSequence, 0u);
+
+    Orderbook recovered{config};
+    ASSERT_EQ(recovered.LoadSnapshot(snapshotPath.string()), snapshotSequence);
+    ReplayJournal(journalPath.string(), recovered, snapshotSequence);
+
+    auto Levels = [](const LevelInfos& infos) {
+        std::vector<std::pair<Price, Quantity>> levels;
+        for (const auto& info : infos)
+            levels.emplace_back(info.price_, info.quantity_);
+        return levels;
+    };
+    const auto expected = live.GetOrderInfos();
+    const auto actual = recovered.GetOrderInfos();
+    ASSERT_EQ(recovered.Size(), live.Size());
+    ASSERT_EQ(Levels(actual.GetBids()), Levels(expected.GetBids()));
+    ASSERT_EQ(Levels(actual.GetAsks()), Levels(expected.GetAsks()));
+
+    ASSERT_THROW(recovered.LoadSnapshot(snapshotPath.string()), std::logic_error);
+    std::filesystem::remove(journalPath);
+    std::filesystem::remove(snapshotPath);
+}
+
+TEST(SnapshotTests, TheJournalSequenceOfASnapshotIsAlreadyInTheFile) {
+    const auto directory = std::filesystem::temp_directory_path();
+    const auto journalPath = directory / "orderbook_snapshot_flush_test.journal";
+    const auto snapshotPath = directory / "orderbook_snapshot_flush_test.snapshot";
+    std::filesystem::remove(journalPath);
+
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook orderbook{config};
+    JournalWriter journal{JournalConfig{journalPath.string(), 64, FsyncPolicy::Never, {}}};
+    orderbook.AttachJournal(&journal);
+    for (OrderId orderId = 1; orderId <= 10; ++orderId)
+        orderbook.AddOrder(Order{OrderType::GoodTillCancel, orderId, Side::Buy, 100, 10});
+
+    // the batch holds 64, none of the 10 would be on disk yet if the process died here
+    const auto sequence = orderbook.SaveSnapshot(snapshotPath.string());
+    ASSERT_EQ(sequence, 10u);
+    ASSERT_EQ(JournalReader{journalPath.string()}.Size(), sequence);
+
+    orderbook.AttachJournal(nullptr);
+    std::filesystem::remove(journalPath);
+    std::filesystem::remove(snapshotPath);
+}
+
+TEST(SnapshotTests, ALoadedSnapshotIsPublishedToDepthReaders) {
+    const auto path = std::filesystem::temp_directory_path() / "orderbook_snapshot_depth_test.snapshot";
+
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook source{config};
+    source.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10});
+    source.SaveSnapshot(path.string());
+
+    config.depthSnapshots_ = true;
+    Orderbook loaded{config};
+    // publish an empty depth first so the load has to publish again, not ride on the initial one
+    loaded.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 105, 10});
+    loaded.CancelOrder(2);
+    ASSERT_TRUE(loaded.GetOrderInfos().GetBids().empty());
+
+    loaded.LoadSnapshot(path.string());
+    const auto infos = loaded.GetOrderInfos();
+    ASSERT_EQ(infos.GetBids().size(), 1u);
+    ASSERT_EQ(infos.GetBids()[0].price_, 100);
+    ASSERT_EQ(infos.GetBids()[0].quantity_, 10u);
+    ASSERT_TRUE(infos.GetAsks().empty());
+    std::filesystem::remove(path);
+}
+
+TEST(LevelUpdateTests, DeltasReplayedOntoAMirrorMatchTheBookDepth) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.levelUpdates_ = true;
+    config.ladderLevels_ = 32; // some levels in the overflow map too
+    OrderFlowConfig flowConfig;
+    flowConfig.levels_ = 100;
+    flowConfig.typeMix_ = {60, 10, 10, 10, 10};
+    OrderFlow flow{flowConfig};
+    Orderbook orderbook{config};
+
+    std::map<std::pair<Side, Price>, Quantity> mirror;
+    LevelUpdates updates;
+    auto Drain = [&]() {
+        orderbook.DrainLevelUpdates(updates);
+        for (const auto& update : updates) {
+            if (update.count_ == 0) {
+                ASSERT_EQ(update.quantity_, 0u);
+                mirror.erase({update.side_, update.price_});
+            }
+            else
+                mirror[{update.side_, update.price_}] = update.quantity_;
         }
+    };
+    for (int i = 0; i < 20000; ++i) {
+        orderbook.Apply(flow.Next());
+        if (i % 37 == 0)
+            Drain();
     }
+    Drain();
+
+    std::map<std::pair<Side, Price>, Quantity> depth;
+    const auto infos = orderbook.GetOrderInfos();
+    for (const auto& level : infos.GetBids())
+        depth[{Side::Buy, level.price_}] = level.quantity_;
+    for (const auto& level : infos.GetAsks())
+        depth[{Side::Sell, level.price_}] = level.quantity_;
+    ASSERT_EQ(mirror, depth);
+
+    const auto top = orderbook.GetDepth(3);
+    ASSERT_EQ(top.GetBids().size(), std::min<std::size_t>(3, infos.GetBids().size()));
+    for (std::size_t i = 0; i < top.GetBids().size(); ++i)
+        ASSERT_EQ(top.GetBids()[i].price_, infos.GetBids()[i].price_);
+}
+
+TEST(LevelUpdateTests, ALoadedSnapshotComesOutAsOneUpdatePerLevel) {
+    const auto path = std::filesystem::temp_directory_path() / "orderbook_level_update_snapshot_test.snapshot";
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook live{config};
+    live.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 99, 10});
+    live.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 99, 5});
+    live.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 98, 7});
+    live.AddOrder(Order{OrderType::GoodTillCancel, 4, Side::Sell, 101, 3});
+    live.SaveSnapshot(path.string());
+
+    config.levelUpdates_ = true;
+    Orderbook recovered{config};
+    recovered.LoadSnapshot(path.string());
+    LevelUpdates updates;
+    recovered.DrainLevelUpdates(updates);
+    const LevelUpdates expected{
+        LevelUpdate{Side::Buy, 99, 15, 2},
+        LevelUpdate{Side::Buy, 98, 7, 1},
+        LevelUpdate{Side::Sell, 101, 3, 1},
+    };
+    ASSERT_EQ(updates.size(), expected.size());
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(updates[i].side_, expected[i].side_);
+        ASSERT_EQ(updates[i].price_, expected[i].price_);
+        ASSERT_EQ(updates[i].quantity_, expected[i].quantity_);
+        ASSERT_EQ(updates[i].count_, expected[i].count_);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(ExpiryTests, OnlyDueOrdersExpireAndCancelsOrFillsUnscheduleThem) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.expiryBatch_ = 2;
+    Orderbook orderbook{config};
+
+    orderbook.AddOrder(Order{OrderType::GoodTillTime, 1, Side::Buy, 100, 10, 300});
+    orderbook.AddOrder(Order{OrderType::GoodTillTime, 2, Side::Buy, 99, 10, 100});
+    orderbook.AddOrder(Order{OrderType::GoodTillTime, 3, Side::Buy, 98, 10, 200});
+    orderbook.AddOrder(Order{OrderType::GoodTillTime, 4, Side::Buy, 97, 10, 100});
+    orderbook.AddOrder(Order{OrderType::GoodTillTime, 5, Side::Buy, 96, 10, 150});
+    orderbook.AddOrder(Order{OrderType::GoodForDay, 6, Side::Buy, 95, 10});
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 7, Side::Buy, 94, 10});
+
+    orderbook.CancelOrder(4);
+    orderbook.AddOrder(Order{OrderType::FillAndKill, 8, Side::Sell, 100, 10}); // fills 1
+    orderbook.ModifyOrder(OrderModify{5, Side::Buy, 93, 5}); // keeps its deadline
+
+    ASSERT_EQ(orderbook.ExpireOrders(99), 0u);
+    ASSERT_EQ(orderbook.ExpireOrders(150), 2u); // 2 and 5, over two batches
+    ASSERT_FALSE(orderbook.Contains(2));
+    ASSERT_FALSE(orderbook.Contains(5));
+    ASSERT_TRUE(orderbook.Contains(3));
+
+    ASSERT_EQ(orderbook.ExpireOrders(1'000'000), 1u);
+    ASSERT_EQ(orderbook.Size(), 2u); // nothing timed is left, GoodForDay waits for the close
+
+    orderbook.CancelGoodForDayOrders();
+    ASSERT_EQ(orderbook.Size(), 1u);
+    ASSERT_TRUE(orderbook.Contains(7));
+}
+
+TEST(ExpiryTests, TheIndexReusesItsNodesOnceWarm) {
+    ExpiryIndex index;
+    std::vector<ExpiryIndex::Handle> handles;
+    auto Cycle = [&](Timestamp base) {
+        for (OrderId orderId = 0; orderId < 3000; ++orderId)
+            handles.push_back(orderId % 3 == 0 ? index.Schedule(ExpiryIndex::EndOfSession, orderId)
+                                               : index.Schedule(base + static_cast<Timestamp>(orderId % 50), orderId));
+        for (auto handle : handles)
+            index.Cancel(handle);
+        handles.clear();
+    };
+    Cycle(0);
+    const std::size_t warm = index.Capacity();
+    ASSERT_GE(warm, 3000u);
+    for (Timestamp base = 100; base < 1000; base += 100)
+        Cycle(base);
+    ASSERT_EQ(index.Capacity(), warm);
+    ASSERT_EQ(index.NextDeadline(), ExpiryIndex::EndOfSession);
+
+    // same deadline, first scheduled comes out first
+    index.Schedule(5, 1);
+    index.Schedule(5, 2);
+    index.Schedule(4, 3);
+    OrderIds due;
+    index.Due(5, 10, due);
+    ASSERT_EQ(due, (OrderIds{3, 1, 2}));
+}
+
+TEST(ExpiryTests, ExpiryThreadWakesUpForAnEarlierDeadline) {
+    Orderbook orderbook; // with its expiry thread, asleep until the close
+    const auto deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(20);
+    const Timestamp expiry = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    orderbook.AddOrder(Order{OrderType::GoodTillTime, 1, Side::Buy, 100, 10, expiry});
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 100, 10});
+
+    for (int i = 0; i < 200 && orderbook.Contains(1); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_FALSE(orderbook.Contains(1));
+    ASSERT_TRUE(orderbook.Contains(2));
+}
+
+TEST(SweepTests, AggressiveOrdersNeverRestOrTouchTheirOwnSide) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.levelUpdates_ = true;
+    Orderbook orderbook{config};
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Sell, 101, 5});
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 103, 5});
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 99, 5});
+    LevelUpdates updates;
+    orderbook.DrainLevelUpdates(updates);
+
+    // more than the whole ask side, the rest is dropped instead of resting at 103
+    const Trades market = orderbook.AddOrder(Order{4, Side::Buy, 20});
+    ASSERT_EQ(market.size(), 2u);
+    ASSERT_EQ(market[0].GetBidTrade().price_, 103); // reported at the worst ask it could reach
+    ASSERT_EQ(market[0].GetAskTrade().price_, 101);
+    ASSERT_EQ(market[1].GetAskTrade().orderId_, 2u);
+    ASSERT_EQ(orderbook.Size(), 1u);
+    ASSERT_FALSE(orderbook.Contains(4));
+
+    // partly filled FillAndKill, the rest goes away too
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 5, Side::Sell, 100, 3});
+    const Trades fak = orderbook.AddOrder(Order{OrderType::FillAndKill, 6, Side::Buy, 100, 10});
+    ASSERT_EQ(fak.size(), 1u);
+    ASSERT_EQ(fak[0].GetBidTrade().price_, 100);
+    ASSERT_EQ(fak[0].GetBidTrade().quantity_, 3u);
+    ASSERT_FALSE(orderbook.Contains(6));
+
+    // the only level changes are on the resting side
+    orderbook.DrainLevelUpdates(updates);
+    for (const auto& update : updates)
+        ASSERT_EQ(update.side_, Side::Sell);
+    const auto depth = orderbook.GetDepth(10);
+    ASSERT_EQ(depth.GetBids().size(), 1u);
+    ASSERT_TRUE(depth.GetAsks().empty());
+}
+TEST(ModifyTests, ReducingInPlaceKeepsPriorityAndMovingLosesIt) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.levelUpdates_ = true;
+    Orderbook orderbook{config};
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10});
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 100, 10});
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 100, 10});
+
+    LevelUpdates updates;
+    orderbook.DrainLevelUpdates(updates);
+    orderbook.ModifyOrder(OrderModify{1, Side::Buy, 100, 4}); // down, stays first
+    orderbook.DrainLevelUpdates(updates);
+    ASSERT_EQ(updates.size(), 1u);
+    ASSERT_EQ(updates[0].quantity_, 24u);
+    ASSERT_EQ(updates[0].count_, 3u);
+
+    orderbook.ModifyOrder(OrderModify{2, Side::Buy, 100, 20}); // up, goes behind 3
+
+    Trades trades = orderbook.AddOrder(Order{OrderType::FillAndKill, 10, Side::Sell, 100, 15});
+    ASSERT_EQ(trades.size(), 3u);
+    ASSERT_EQ(trades[0].GetBidTrade().orderId_, 1u);
+    ASSERT_EQ(trades[0].GetBidTrade().quantity_, 4u);
+    ASSERT_EQ(trades[1].GetBidTrade().orderId_, 3u);
+    ASSERT_EQ(trades[2].GetBidTrade().orderId_, 2u);
+    ASSERT_EQ(trades[2].GetBidTrade().quantity_, 1u);
+
+    // moving across the spread trades like a new order
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 20, Side::Sell, 105, 5});
+    trades = orderbook.ModifyOrder(OrderModify{2, Side::Buy, 105, 5});
+    ASSERT_EQ(trades.size(), 1u);
+    ASSERT_EQ(orderbook.Size(), 0u);
+
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 30, Side::Sell, 105, 5});
+    orderbook.ModifyOrder(OrderModify{30, Side::Sell, 105, 0}); // down to nothing
+    ASSERT_FALSE(orderbook.Contains(30));
+}
+
+TEST(TradeSinkTests, FillsReachTheSinkInTheOrderTheVectorApiReturnsThem) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook withVector{config}, withSink{config};
+    for (OrderId id = 1; id <= 5; ++id) {
+        withVector.AddOrder(Order{OrderType::GoodTillCancel, id, Side::Sell, static_cast<Price>(100 + id), 10});
+        withSink.AddOrder(Order{OrderType::GoodTillCancel, id, Side::Sell, static_cast<Price>(100 + id), 10});
+    }
+
+    const Trades expected = withVector.AddOrder(Order{OrderType::FillAndKill, 9, Side::Buy, 104, 35});
+
+    std::vector<std::pair<OrderId, Quantity>> seen;
+    withSink.AddOrder(Order{OrderType::FillAndKill, 9, Side::Buy, 104, 35}, [&](const Trade& trade) {
+        seen.emplace_back(trade.GetAskTrade().orderId_, trade.GetAskTrade().quantity_);
+    });
+    ASSERT_EQ(expected.size(), 4u);
+    ASSERT_EQ(seen.size(), expected.size());
+    for (std::size_t i = 0; i < seen.size(); ++i) {
+        ASSERT_EQ(seen[i].first, expected[i].GetAskTrade().orderId_);
+        ASSERT_EQ(seen[i].second, expected[i].GetAskTrade().quantity_);
+    }
+
+    // a buffer the caller keeps is appended to, its capacity carries over
+    Trades buffer;
+    buffer.reserve(16);
+    const auto* storage = buffer.data();
+    withSink.ModifyOrder(OrderModify{5, Side::Sell, 99, 10}, buffer);
+    ASSERT_TRUE(buffer.empty());
+    withSink.AddOrder(Order{OrderType::GoodTillCancel, 10, Side::Buy, 105, 15}, buffer);
+    ASSERT_EQ(buffer.size(), 2u);
+    ASSERT_EQ(buffer.data(), storage);
+}
+
+TEST(PolicyTests, SingleThreadedBookTradesLikeTheDefaultBook) {
+    static_assert(std::is_same_v<Orderbook, BasicOrderbook<DefaultOrderbookPolicy>>);
+
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.ladderLevels_ = 64; // small window so the flow also lands in the overflow maps
+    OrderFlowConfig flowConfig;
+    flowConfig.typeMix_ = {70, 10, 5, 10, 5};
+    OrderFlow flow{flowConfig};
+
+    Orderbook shared{config};
+    SingleThreadedOrderbook owned{config};
+    std::size_t sharedFills = 0, ownedFills = 0;
+    for (int i = 0; i < 20000; ++i) {
+        const Command command = flow.Next();
+        shared.Apply(command, [&](const Trade&) { ++sharedFills; });
+        owned.Apply(command, [&](const Trade&) { ++ownedFills; });
+        if (i % 5000 == 4999) {
+            shared.CancelGoodForDayOrders();
+            owned.CancelGoodForDayOrders();
+        }
+    }
+    ASSERT_GT(sharedFills, 0u);
+    ASSERT_EQ(ownedFills, sharedFills);
+    ASSERT_EQ(owned.Size(), shared.Size());
+
+    const auto expected = shared.GetDepth(10);
+    const auto actual = owned.GetDepth(10);
+    ASSERT_EQ(actual.GetBids().size(), expected.GetBids().size());
+    ASSERT_EQ(actual.GetAsks().size(), expected.GetAsks().size());
+    for (std::size_t i = 0; i < expected.GetBids().size(); ++i) {
+        ASSERT_EQ(actual.GetBids()[i].price_, expected.GetBids()[i].price_);
+        ASSERT_EQ(actual.GetBids()[i].quantity_, expected.GetBids()[i].quantity_);
+    }
+    for (std::size_t i = 0; i < expected.GetAsks().size(); ++i) {
+        ASSERT_EQ(actual.GetAsks()[i].price_, expected.GetAsks()[i].price_);
+        ASSERT_EQ(actual.GetAsks()[i].quantity_, expected.GetAsks()[i].quantity_);
+    }
+}
+TEST(BatchTests, ApplyBatchMatchesApplyingOneByOne) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    OrderFlowConfig flowConfig;
+    flowConfig.typeMix_ = {70, 10, 5, 10, 5};
+    OrderFlow flow{flowConfig};
+
+    std::vector<Command> commands;
+    for (int i = 0; i < 20000; ++i) {
+        commands.push_back(flow.Next());
+        if (i % 5000 == 4999)
+            commands.push_back(Command::PruneGoodForDay());
+    }
+    commands.push_back(commands.front()); // a duplicate add is dropped in a batch too
+
+    Orderbook single{config}, batched{config};
+    Trades expected;
+    for (const auto& command : commands)
+        single.Apply(command, expected);
+
+    Trades actual;
+    const std::span<const Command> all{commands};
+    for (std::size_t begin = 0; begin < all.size(); begin += 37)
+        batched.ApplyBatch(all.subspan(begin, std::min<std::size_t>(37, all.size() - begin)), actual);
+
+    ASSERT_GT(expected.size(), 0u);
+    ASSERT_EQ(actual.size(), expected.size());
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(actual[i].GetBidTrade().orderId_, expected[i].GetBidTrade().orderId_);
+        ASSERT_EQ(actual[i].GetAskTrade().orderId_, expected[i].GetAskTrade().orderId_);
+        ASSERT_EQ(actual[i].GetBidTrade().quantity_, expected[i].GetBidTrade().quantity_);
+    }
+    ASSERT_EQ(batched.Size(), single.Size());
+}
+TEST(BatchTests, EveryCommandOfABatchGetsItsResult) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook orderbook{config};
+
+    Command iceberg = Command::Add(Order{OrderType::FillAndKill, 9, Side::Sell, 100, 5});
+    iceberg.peak_ = 2;
+    const std::vector<Command> commands{
+        Command::Add(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10}),
+        Command::Add(Order{OrderType::GoodTillCancel, 2, Side::Buy, 100, 10}),
+        Command::Add(Order{OrderType::GoodTillCancel, 1, Side::Buy, 99, 10}),
+        iceberg, // would throw out of ToOrder, the commands after it still go in
+        Command::Add(Order{OrderType::FillAndKill, 3, Side::Sell, 100, 15}),
+        Command::Cancel(7),
+        Command::Modify(OrderModify{7, Side::Buy, 100, 10}),
+        Command::Cancel(2),
+        Command::AuctionStart(),
+        Command::Add(Order{4, Side::Sell, 5}),
+        Command::AuctionUncross(),
+    };
+    std::vector<CommandResult> results(commands.size());
+    Trades trades;
+    orderbook.ApplyBatch(commands, trades, results);
+
+    const std::vector<RejectReason> reasons{
+        RejectReason::None, RejectReason::None, RejectReason::DuplicateOrderId, RejectReason::InvalidIceberg,
+        RejectReason::None, RejectReason::UnknownOrder, RejectReason::UnknownOrder, RejectReason::None,
+        RejectReason::None, RejectReason::AuctionPhase, RejectReason::None,
+    };
+    for (std::size_t i = 0; i < commands.size(); ++i) {
+        ASSERT_EQ(results[i].reason_, reasons[i]) << "command " << i;
+        ASSERT_EQ(results[i].fills_, i == 4 ? 2u : 0u) << "command " << i;
+    }
+    // the fills of command 4, in order
+    ASSERT_EQ(trades.size(), 2u);
+    ASSERT_EQ(trades[0].GetBidTrade().orderId_, 1u);
+    ASSERT_EQ(trades[1].GetBidTrade().orderId_, 2u);
+    ASSERT_EQ(trades[1].GetBidTrade().quantity_, 5u);
+    ASSERT_FALSE(orderbook.Contains(2));
+
+    ASSERT_EQ(orderbook.Apply(iceberg, trades), RejectReason::InvalidIceberg);
+    ASSERT_EQ(orderbook.Apply(Command::Cancel(1), trades), RejectReason::UnknownOrder);
+    std::vector<CommandResult> tooFew(1);
+    ASSERT_THROW(orderbook.ApplyBatch(commands, trades, tooFew), std::invalid_argument);
+}
+TEST(BatchTests, TradeTapeHashIsPinnedWhicheverWayTheSessionIsApplied) {
+    // a fixed session touching every command and order type, a hash change here means the book
+    // now trades differently, which is either a bug or needs the new value pinned on purpose
+    static constexpr std::string_view Session =
+        "A B GoodTillCancel 100 10 1\n"
+        "A B GoodTillCancel 99 20 2\n"
+        "A B GoodForDay 98 30 3\n"
+        "A S GoodTillCancel 102 10 4\n"
+        "A S GoodTillCancel 103 40 5 10\n"
+        "A S GoodTillTime 104 15 6 1000\n"
+        "A S FillAndKill 99 15 7\n"
+        "M 2 B 101 25\n"
+        "A S FillOrKill 100 100 8\n"
+        "A S FillOrKill 101 5 9\n"
+        "A B Market 0 25 10\n"
+        "A B GoodTillCancel 103 12 11\n"
+        "C 3\n"
+        "A B GoodTillCancel 97 50 12\n"
+        "E 1000\n"
+        "S\n"
+        "A B GoodTillCancel 105 30 13\n"
+        "A S GoodTillCancel 96 20 14\n"
+        "A S GoodTillCancel 97 25 15\n"
+        "U\n"
+        "A S Market 0 40 16\n"
+        "A B GoodForDay 95 10 17\n"
+        "P\n"
+        "A S GoodTillCancel 95 5 18\n";
+
+    std::vector<Command> commands;
+    CommandParser parser{Session};
+    for (Command command; parser.Next(command);)
+        commands.push_back(command);
+
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    SingleThreadedOrderbook single{config}, batched{config};
+    TradeTapeHash perCommand, perBatch;
+    for (const auto& command : commands)
+        single.Apply(command, perCommand);
+    const std::span<const Command> all{commands};
+    for (std::size_t begin = 0; begin < all.size(); begin += 5)
+        batched.ApplyBatch(all.subspan(begin, std::min<std::size_t>(5, all.size() - begin)), perBatch);
+
+    ASSERT_EQ(perBatch.Trades(), 14u);
+    ASSERT_EQ(perBatch.Value(), 0xe799df923efc6c93ull); // also what orderbook_driver_bin prints for this session
+    ASSERT_EQ(perBatch.Trades(), perCommand.Trades());
+    ASSERT_EQ(perBatch.Value(), perCommand.Value());
+    ASSERT_EQ(batched.Size(), single.Size());
+}
+TEST(TopOfBookTests, ReadersNeverSeeATornTopOfBook) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook orderbook{config};
+
+    // every trade is at 100, a consistent snapshot always has sum = 100 * volume and a book that is not crossed
+    std::atomic<bool> done{false};
+    std::thread reader([&] {
+        std::uint64_t lastVolume = 0;
+        while (!done.load(std::memory_order_relaxed)) {
+            const TopOfBook top = orderbook.GetTopOfBook();
+            ASSERT_EQ(top.priceVolumeSum_, 100u * top.totalVolumeTraded_);
+            ASSERT_GE(top.totalVolumeTraded_, lastVolume);
+            if (top.HasBid() && top.HasAsk()) {
+                ASSERT_LT(top.bestBid_, top.bestAsk_);
+            }
+            lastVolume = top.totalVolumeTraded_;
+        }
+    });
+
+    OrderId orderId = 1;
+    for (int i = 0; i < 20000; ++i) {
+        orderbook.AddOrder(Order{OrderType::GoodTillCancel, orderId++, Side::Buy, 99 - i % 3, 5});
+        orderbook.AddOrder(Order{OrderType::GoodTillCancel, orderId++, Side::Sell, 100, 7});
+        orderbook.AddOrder(Order{OrderType::FillAndKill, orderId++, Side::Buy, 100, 7});
+        orderbook.CancelOrder(orderId - 3);
+    }
+    done = true;
+    reader.join();
+
+    const TopOfBook top = orderbook.GetTopOfBook();
+    ASSERT_EQ(top.totalVolumeTraded_, 2 * 20000u * 7); // the stats count a fill once per side
+    ASSERT_EQ(top.lastTradedPrice_, 100);
+    ASSERT_FALSE(top.HasAsk());
+    ASSERT_FALSE(top.HasBid());
+    ASSERT_EQ(top.orders_, 0u);
+    ASSERT_EQ(orderbook.Size(), 0u);
+}
+TEST(DepthTests, AHeldSnapshotIsNotReusedUntilItsReaderIsDone) {
+    EpochPublisher<std::vector<int>> publisher{4};
+    publisher.Prepare() = {1, 2, 3};
+    publisher.Publish();
+
+    {
+        const auto held = publisher.Read();
+        for (int i = 0; i < 100; ++i) {
+            auto& next = publisher.Prepare();
+            next.assign(3, i);
+            publisher.Publish();
+        }
+        ASSERT_EQ(*held, (std::vector<int>{1, 2, 3}));
+        ASSERT_EQ(publisher.Retired(), 100u);
+
+        const auto latest = publisher.Read();
+        ASSERT_EQ(*latest, (std::vector<int>{99, 99, 99}));
+    }
+
+    // nobody reads any more, the next publish gets everything back and after that two are enough
+    for (int i = 0; i < 10; ++i) {
+        publisher.Prepare().assign(1, i);
+        publisher.Publish();
+        ASSERT_EQ(publisher.Retired(), 0u);
+    }
+    ASSERT_EQ(*publisher.Read(), std::vector<int>{9});
+}
+TEST(DepthTests, ReadersSeeWholeBatchesWhileTheBookTrades) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.depthSnapshots_ = true;
+    Orderbook orderbook{config};
+    OrderFlow flow{OrderFlowConfig{}};
+
+    std::atomic<bool> done{false};
+    auto Read = [&] {
+        std::uint64_t lastVersion = 0;
+        while (!done.load(std::memory_order_relaxed)) {
+            const auto depth = orderbook.ReadDepth();
+            ASSERT_GE(depth->version_, lastVersion);
+            lastVersion = depth->version_;
+            for (std::size_t i = 1; i < depth->bids_.size(); ++i)
+                ASSERT_GT(depth->bids_[i - 1].price_, depth->bids_[i].price_);
+            for (std::size_t i = 1; i < depth->asks_.size(); ++i)
+                ASSERT_LT(depth->asks_[i - 1].price_, depth->asks_[i].price_);
+            if (!depth->bids_.empty() && !depth->asks_.empty()) {
+                ASSERT_LT(depth->bids_.front().price_, depth->asks_.front().price_);
+            }
+        }
+    };
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i)
+        readers.emplace_back(Read);
+
+    std::vector<Command> batch;
+    for (int i = 0; i < 500; ++i) {
+        batch.clear();
+        for (int j = 0; j < 64; ++j)
+            batch.push_back(flow.Next());
+        orderbook.ApplyBatch(batch);
+    }
+    done = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    // what the readers get is what the book holds
+    const auto published = orderbook.GetOrderInfos();
+    const auto walked = orderbook.GetDepth(std::numeric_limits<std::size_t>::max());
+    ASSERT_GT(walked.GetBids().size(), 0u);
+    ASSERT_EQ(published.GetBids().size(), walked.GetBids().size());
+    ASSERT_EQ(published.GetAsks().size(), walked.GetAsks().size());
+    for (std::size_t i = 0; i < walked.GetBids().size(); ++i) {
+        ASSERT_EQ(published.GetBids()[i].price_, walked.GetBids()[i].price_);
+        ASSERT_EQ(published.GetBids()[i].quantity_, walked.GetBids()[i].quantity_);
+    }
+    for (std::size_t i = 0; i < walked.GetAsks().size(); ++i) {
+        ASSERT_EQ(published.GetAsks()[i].price_, walked.GetAsks()[i].price_);
+        ASSERT_EQ(published.GetAsks()[i].quantity_, walked.GetAsks()[i].quantity_);
+    }
+}
+TEST(RiskTests, ChecksRejectWithAReasonAndFollowFillsCancelsAndAmends) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.risk_.enabled_ = true;
+    config.risk_.accounts_ = 4;
+    config.risk_.maxOrderQuantity_ = 1000;
+    config.risk_.priceBandBps_ = 1000; // 10%
+    config.risk_.limits_ = AccountLimits{100, 20000};
+    Orderbook orderbook{config};
+    orderbook.SetAccountLimits(3, AccountLimits{100, 5000});
+    auto Limit = [](OrderId orderId, Side side, Price price, Quantity quantity, AccountId account) {
+        return Order{OrderType::GoodTillCancel, orderId, side, price, quantity, Timestamp{}, account};
+    };
+    Trades trades;
+
+    ASSERT_EQ(orderbook.AddOrder(Limit(1, Side::Sell, 100, 10, 7), trades), RejectReason::UnknownAccount);
+    ASSERT_EQ(orderbook.AddOrder(Limit(1, Side::Sell, 100, 1001, 1), trades), RejectReason::OrderTooLarge);
+    ASSERT_EQ(orderbook.AddOrder(Limit(1, Side::Sell, 100, 50, 1), trades), RejectReason::None); // empty book, no band yet
+    ASSERT_EQ(orderbook.AddOrder(Limit(1, Side::Sell, 100, 50, 1), trades), RejectReason::DuplicateOrderId);
+    ASSERT_EQ(orderbook.GetAccountRisk(1).openSell_, 50u);
+    ASSERT_EQ(orderbook.GetAccountRisk(1).openNotional_, 5000u);
+
+    // banded around the best ask until something trades, then around the last trade
+    ASSERT_EQ(orderbook.AddOrder(Limit(2, Side::Buy, 120, 30, 2), trades), RejectReason::PriceBand);
+    ASSERT_EQ(orderbook.AddOrder(Limit(2, Side::Buy, 105, 30, 2), trades), RejectReason::None);
+    ASSERT_EQ(trades.size(), 1u);
+    ASSERT_EQ(orderbook.GetAccountRisk(2).position_, 30);
+    ASSERT_EQ(orderbook.GetAccountRisk(2).openBuy_, 0u);
+    ASSERT_EQ(orderbook.GetAccountRisk(2).openNotional_, 0u);
+    ASSERT_EQ(orderbook.GetAccountRisk(1).position_, -30);
+    ASSERT_EQ(orderbook.GetAccountRisk(1).openSell_, 20u);
+    ASSERT_EQ(orderbook.GetAccountRisk(1).openNotional_, 2000u);
+
+    // 30 bought and 80 more bid could make 110
+    ASSERT_EQ(orderbook.AddOrder(Limit(3, Side::Buy, 99, 80, 2), trades), RejectReason::PositionLimit);
+    ASSERT_EQ(orderbook.AddOrder(Limit(3, Side::Buy, 99, 70, 2), trades), RejectReason::None);
+    ASSERT_EQ(orderbook.AddOrder(Limit(4, Side::Buy, 95, 60, 3), trades), RejectReason::NotionalLimit);
+    ASSERT_EQ(orderbook.GetAccountRisk(2).openBuy_, 70u);
+
+    // a rejected move leaves the order where it was, amends and cancels give the room back
+    ASSERT_EQ(orderbook.ModifyOrder(OrderModify{3, Side::Buy, 50, 70}, trades), RejectReason::PriceBand);
+    ASSERT_EQ(orderbook.GetDepth(1).GetBids()[0].price_, 99);
+    ASSERT_EQ(orderbook.ModifyOrder(OrderModify{3, Side::Buy, 99, 40}, trades), RejectReason::None);
+    ASSERT_EQ(orderbook.GetAccountRisk(2).openBuy_, 40u);
+    ASSERT_EQ(orderbook.GetAccountRisk(2).openNotional_, 99u * 40);
+    ASSERT_EQ(orderbook.ModifyOrder(OrderModify{9, Side::Buy, 99, 40}, trades), RejectReason::UnknownOrder);
+    orderbook.CancelOrder(3);
+    ASSERT_EQ(orderbook.GetAccountRisk(2).openBuy_, 0u);
+    ASSERT_EQ(orderbook.GetAccountRisk(2).openNotional_, 0u);
+
+    // orders that never rest only move the position
+    trades.clear();
+    ASSERT_EQ(orderbook.AddOrder(Order{5, Side::Buy, 20, 2}, trades), RejectReason::None);
+    ASSERT_EQ(trades.size(), 1u);
+    ASSERT_EQ(orderbook.GetAccountRisk(2).position_, 50);
+    ASSERT_EQ(orderbook.GetAccountRisk(2).openBuy_, 0u);
+    ASSERT_EQ(orderbook.GetAccountRisk(1).position_, -50);
+    ASSERT_EQ(orderbook.GetAccountRisk(1).openSell_, 0u);
+    ASSERT_EQ(orderbook.GetAccountRisk(1).openNotional_, 0u);
+
+    // the account goes through the journal with the order
+    const Command add = Command::Add(Limit(6, Side::Buy, 100, 1, 3));
+    ASSERT_EQ(JournalRecord::From(0, add).ToCommand().account_, 3u);
+}
+TEST(RiskTests, TheBandFollowsThePriceASweepExecutedAt) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.risk_.enabled_ = true;
+    config.risk_.accounts_ = 2;
+    config.risk_.priceBandBps_ = 1000; // 10%
+    Orderbook orderbook{config};
+    Trades trades;
+
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10}, trades);
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 95, 10}, trades);
+    // a sell limited at 90 sweeps both bids, it executed at 95 last, not at its limit
+    ASSERT_EQ(orderbook.AddOrder(Order{OrderType::FillAndKill, 3, Side::Sell, 90, 20}, trades), RejectReason::None);
+    ASSERT_EQ(trades.size(), 2u);
+    ASSERT_EQ(orderbook.GetTopOfBook().lastTradedPrice_, 95);
+
+    // 104 is within 10% of 95 but not of 90
+    ASSERT_EQ(orderbook.AddOrder(Order{OrderType::GoodTillCancel, 4, Side::Buy, 104, 10}, trades), RejectReason::None);
+    ASSERT_EQ(orderbook.AddOrder(Order{OrderType::GoodTillCancel, 5, Side::Buy, 105, 10}, trades), RejectReason::PriceBand);
+
+    // and a buy sweeping up ends at the last ask it took
+    orderbook.CancelOrder(4);
+    ASSERT_EQ(orderbook.AddOrder(Order{OrderType::GoodTillCancel, 6, Side::Sell, 99, 10}, trades), RejectReason::None);
+    ASSERT_EQ(orderbook.AddOrder(Order{OrderType::GoodTillCancel, 7, Side::Sell, 100, 10}, trades), RejectReason::None);
+    ASSERT_EQ(orderbook.AddOrder(Order{OrderType::FillAndKill, 8, Side::Buy, 104, 20}, trades), RejectReason::None);
+    ASSERT_EQ(orderbook.GetTopOfBook().lastTradedPrice_, 100);
+
+    // no accounts are kept while risk is off
+    config.risk_.enabled_ = false;
+    Orderbook unchecked{config};
+    ASSERT_THROW(unchecked.SetAccountLimits(0, AccountLimits{}), std::logic_error);
+    ASSERT_THROW(unchecked.GetAccountRisk(0), std::logic_error);
+    ASSERT_THROW(orderbook.GetAccountRisk(2), std::out_of_range);
+}
+TEST(RiskTests, PositionsAndLimitsComeBackFromASnapshotAndTheJournalTail) {
+    const auto directory = std::filesystem::temp_directory_path();
+    const auto journalPath = directory / "orderbook_risk_restart_test.journal";
+    const auto snapshotPath = directory / "orderbook_risk_restart_test.snapshot";
+    std::filesystem::remove(journalPath);
+
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.risk_.enabled_ = true;
+    config.risk_.accounts_ = 4;
+    auto Limit = [](OrderId orderId, Side side, Price price, Quantity quantity, AccountId account) {
+        return Order{OrderType::GoodTillCancel, orderId, side, price, quantity, Timestamp{}, account};
+    };
+
+    Orderbook live{config};
+    std::uint64_t sequence = 0;
+    {
+        JournalWriter journal{JournalConfig{journalPath.string(), 64, FsyncPolicy::Never, {}}};
+        live.AttachJournal(&journal);
+        live.SetAccountLimits(1, AccountLimits{50, 100000});
+        live.AddOrder(Limit(1, Side::Sell, 100, 40, 0));
+        live.AddOrder(Limit(2, Side::Buy, 100, 30, 1));
+        live.AddOrder(Limit(3, Side::Buy, 90, 10, 1)); // rests, open again after the load
+        sequence = live.SaveSnapshot(snapshotPath.string());
+        live.SetAccountLimits(2, AccountLimits{10, 100000}); // only in the tail
+        live.AttachJournal(nullptr);
+    }
+
+    Orderbook restarted{config};
+    Trades trades;
+    restarted.LoadSnapshot(snapshotPath.string());
+    ASSERT_EQ(ReplayJournal(journalPath.string(), restarted, sequence), 1u);
+    for (AccountId account = 0; account < 4; ++account) {
+        ASSERT_EQ(restarted.GetAccountRisk(account).position_, live.GetAccountRisk(account).position_);
+        ASSERT_EQ(restarted.GetAccountRisk(account).openBuy_, live.GetAccountRisk(account).openBuy_);
+        ASSERT_EQ(restarted.GetAccountRisk(account).openSell_, live.GetAccountRisk(account).openSell_);
+    }
+    ASSERT_EQ(restarted.GetAccountRisk(1).position_, 30);
+    // 30 bought, 10 bid and 11 more is over 50, as it would be on the live book
+    ASSERT_EQ(restarted.AddOrder(Limit(4, Side::Buy, 95, 11, 1), trades), RejectReason::PositionLimit);
+    ASSERT_EQ(restarted.AddOrder(Limit(4, Side::Buy, 95, 10, 1), trades), RejectReason::None);
+    ASSERT_EQ(restarted.AddOrder(Limit(5, Side::Buy, 95, 11, 2), trades), RejectReason::PositionLimit);
+
+    // limits go through the text format too, and a book without risk turns them away instead of throwing
+    CommandParser parser{"L 2 10 100000\n"};
+    Command command;
+    ASSERT_TRUE(parser.Next(command));
+    ASSERT_EQ(command.type_, CommandType::SetAccountLimits);
+    ASSERT_EQ(command.ToAccountLimits().maxPosition_, 10);
+    config.risk_.enabled_ = false;
+    Orderbook unchecked{config};
+    ASSERT_EQ(unchecked.Apply(command, [](const Trade&) {}), RejectReason::UnknownAccount);
+    std::filesystem::remove(journalPath);
+    std::filesystem::remove(snapshotPath);
+}
+TEST(RiskTests, TheEngineReportsRiskRejects) {
+    MatchingEngineConfig config;
+    config.book_.risk_.enabled_ = true;
+    config.book_.risk_.accounts_ = 2;
+    config.book_.risk_.maxOrderQuantity_ = 100;
+    MatchingEngine engine{config};
+    engine.AddInstrument(0);
+    auto& session = engine.OpenSession();
+    engine.Start();
+
+    ASSERT_TRUE(session.TrySubmit(Command::Add(Order{OrderType::GoodTillCancel, 1, Side::Buy, 100, 10, Timestamp{}, 2})));
+    ASSERT_TRUE(session.TrySubmit(Command::Add(Order{OrderType::GoodTillCancel, 2, Side::Buy, 100, 500, Timestamp{}, 1})));
+    ASSERT_TRUE(session.TrySubmit(Command::Add(Order{OrderType::GoodTillCancel, 3, Side::Buy, 100, 50, Timestamp{}, 1})));
+
+    std::vector<ExecutionReport> reports;
+    ExecutionReport report;
+    while (reports.size() < 3) {
+        if (session.TryPoll(report))
+            reports.push_back(report);
+    }
+    engine.Stop();
+
+    ASSERT_EQ(reports[0].type_, ReportType::Rejected);
+    ASSERT_EQ(reports[0].reason_, RejectReason::UnknownAccount);
+    ASSERT_EQ(reports[1].reason_, RejectReason::OrderTooLarge);
+    ASSERT_EQ(reports[2].type_, ReportType::Accepted);
+    ASSERT_EQ(engine.Book().Size(), 1u);
+}
+TEST(AuctionTests, EquilibriumExecutesTheMostThenLeavesTheLeastThenStaysNearTheReference) {
+    const LevelInfos asks{{100, 10}, {101, 20}, {103, 10}};
+    const LevelInfos bids{{104, 5}, {102, 15}, {101, 10}};
+    ASSERT_EQ(FindEquilibrium(asks, bids, 0), (AuctionResult{101, 30, 0}));
+
+    // 100 and 102 both trade 10 with nothing left over
+    ASSERT_EQ(FindEquilibrium({{100, 10}}, {{102, 10}}, 0).price_, 100);
+    ASSERT_EQ(FindEquilibrium({{100, 10}}, {{102, 10}}, 110).price_, 102);
+    ASSERT_EQ(FindEquilibrium({}, {{102, 10}}, 0).volume_, 0u);
+}
+TEST(AuctionTests, OrdersRestUntilTheUncrossTradesEverythingAtOnePrice) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook orderbook{config};
+    std::mt19937 random{7};
+    std::uniform_int_distribution<Price> prices{90, 110};
+    std::uniform_int_distribution<Quantity> quantities{1, 50};
+
+    orderbook.StartAuction();
+    ASSERT_TRUE(orderbook.InAuction());
+    std::map<Price, std::uint64_t> bidQuantity, askQuantity;
+    Trades trades;
+    for (OrderId orderId = 1; orderId <= 2000; ++orderId) {
+        const Side side = orderId % 2 ? Side::Buy : Side::Sell;
+        const Price price = prices(random);
+        const Quantity quantity = quantities(random);
+        ASSERT_EQ(orderbook.AddOrder(Order{OrderType::GoodTillCancel, orderId, side, price, quantity}, trades), RejectReason::None);
+        (side == Side::Buy ? bidQuantity : askQuantity)[price] += quantity;
+    }
+    ASSERT_TRUE(trades.empty());
+    ASSERT_EQ(orderbook.AddOrder(Order{9000, Side::Buy, 10}, trades), RejectReason::AuctionPhase);
+    ASSERT_EQ(orderbook.AddOrder(Order{OrderType::FillAndKill, 9001, Side::Buy, 110, 10}, trades), RejectReason::AuctionPhase);
+
+    // most volume any single price could trade, the hard way
+    std::uint64_t most = 0;
+    for (Price price = 90; price <= 110; ++price) {
+        std::uint64_t demand = 0, supply = 0;
+        for (const auto& [bid, quantity] : bidQuantity) if (bid >= price) demand += quantity;
+        for (const auto& [ask, quantity] : askQuantity) if (ask <= price) supply += quantity;
+        most = std::max(most, std::min(demand, supply));
+    }
+    const AuctionResult indicative = orderbook.GetIndicativeUncross();
+    ASSERT_EQ(indicative.volume_, most);
+    ASSERT_TRUE(orderbook.GetTopOfBook().auction_);
+    ASSERT_EQ(orderbook.GetTopOfBook().indicativeVolume_, most);
+
+    const AuctionResult result = orderbook.Uncross(trades);
+    ASSERT_EQ(result, indicative);
+    ASSERT_FALSE(orderbook.InAuction());
+    std::uint64_t traded = 0;
+    for (const auto& trade : trades) {
+        ASSERT_EQ(trade.GetBidTrade().price_, result.price_);
+        ASSERT_EQ(trade.GetAskTrade().price_, result.price_);
+        traded += trade.GetBidTrade().quantity_;
+    }
+    ASSERT_EQ(traded, most);
+    const TopOfBook top = orderbook.GetTopOfBook();
+    ASSERT_LT(top.bestBid_, top.bestAsk_);
+    ASSERT_FALSE(top.auction_);
+    ASSERT_EQ(top.lastTradedPrice_, result.price_);
+
+    // back to continuous, an order that crosses trades right away
+    trades.clear();
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 9002, Side::Buy, top.bestAsk_, 1}, trades);
+    ASSERT_EQ(trades.size(), 1u);
+}
+TEST(AuctionTests, ASnapshotTakenDuringAnAuctionLoadsBackIntoIt) {
+    const auto directory = std::filesystem::temp_directory_path();
+    const auto journalPath = directory / "orderbook_auction_snapshot_test.journal";
+    const auto snapshotPath = directory / "orderbook_auction_snapshot_test.snapshot";
+    std::filesystem::remove(journalPath);
+
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook live{config};
+    Trades liveTrades;
+    std::uint64_t sequence = 0;
+    {
+        JournalWriter journal{JournalConfig{journalPath.string(), 64, FsyncPolicy::Never, {}}};
+        live.AttachJournal(&journal);
+        live.StartAuction();
+        live.AddOrder(Order{OrderType::GoodTillCancel, 1, Side::Buy, 102, 10});
+        live.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 98, 10});
+        live.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 101, 15});
+        sequence = live.SaveSnapshot(snapshotPath.string()); // the book is crossed here
+        live.AddOrder(Order{OrderType::GoodTillCancel, 4, Side::Sell, 100, 20});
+        live.Uncross(liveTrades);
+        live.AddOrder(Order{OrderType::GoodTillCancel, 5, Side::Buy, 100, 3}, liveTrades); // continuous again
+        live.AttachJournal(nullptr);
+    }
+
+    Orderbook restarted{config};
+    restarted.LoadSnapshot(snapshotPath.string());
+    ASSERT_TRUE(restarted.InAuction());
+    ASSERT_TRUE(restarted.GetTopOfBook().auction_);
+    ASSERT_EQ(restarted.GetIndicativeUncross().volume_, 10u);
+
+    Trades trades;
+    for (const auto& record : JournalReader{journalPath.string()})
+        if (record.sequence_ >= sequence)
+            restarted.Apply(record.ToCommand(), trades);
+
+    // the tail's uncross trades the cross at the equilibrium, not the add after it at continuous prices
+    ASSERT_FALSE(restarted.InAuction());
+    ASSERT_EQ(trades.size(), liveTrades.size());
+    for (std::size_t i = 0; i < trades.size(); ++i) {
+        ASSERT_EQ(trades[i].GetBidTrade().orderId_, liveTrades[i].GetBidTrade().orderId_);
+        ASSERT_EQ(trades[i].GetAskTrade().orderId_, liveTrades[i].GetAskTrade().orderId_);
+        ASSERT_EQ(trades[i].GetBidTrade().price_, liveTrades[i].GetBidTrade().price_);
+        ASSERT_EQ(trades[i].GetBidTrade().quantity_, liveTrades[i].GetBidTrade().quantity_);
+    }
+    ASSERT_GT(trades.size(), 2u);
+    ASSERT_EQ(trades[0].GetBidTrade().price_, 100);
+    ASSERT_EQ(trades[0].GetAskTrade().price_, 100);
+    ASSERT_EQ(restarted.Size(), live.Size());
+    std::filesystem::remove(journalPath);
+    std::filesystem::remove(snapshotPath);
+}
+TEST(AuctionTests, TheIndicativeAgreesWithAFullPassAfterEveryChange) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.ladderLevels_ = 16; // most levels end up outside the window
+    Orderbook orderbook{config};
+    std::mt19937 random{11};
+    std::uniform_int_distribution<Price> prices{70, 130};
+    std::uniform_int_distribution<Quantity> quantities{1, 20};
+
+    orderbook.StartAuction();
+    std::vector<OrderId> resting;
+    for (OrderId orderId = 1; orderId <= 600; ++orderId) {
+        if (!resting.empty() && random() % 4 == 0) {
+            const std::size_t victim = random() % resting.size();
+            orderbook.CancelOrder(resting[victim]);
+            resting[victim] = resting.back();
+            resting.pop_back();
+        }
+        else {
+            orderbook.AddOrder(Order{OrderType::GoodTillCancel, orderId, orderId % 2 ? Side::Buy : Side::Sell, prices(random), quantities(random)});
+            resting.push_back(orderId);
+        }
+
+        const auto infos = orderbook.GetOrderInfos();
+        AuctionResult expected;
+        if (!infos.GetBids().empty() && !infos.GetAsks().empty()) {
+            const Price reference = static_cast<Price>((static_cast<std::int64_t>(infos.GetBids().front().price_) + infos.GetAsks().front().price_) / 2);
+            expected = FindEquilibrium(infos.GetAsks(), infos.GetBids(), reference);
+        }
+        ASSERT_EQ(orderbook.GetIndicativeUncross(), expected) << "after order " << orderId;
+    }
+
+    Trades trades;
+    const AuctionResult indicative = orderbook.GetIndicativeUncross();
+    ASSERT_GT(indicative.volume_, 0u);
+    ASSERT_EQ(orderbook.Uncross(trades), indicative);
+}
+TEST(AuctionTests, AClosingUncrossTakesTheGoodForDayOrdersThatDidNotTrade) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook orderbook{config};
+    orderbook.StartAuction();
+    orderbook.AddOrder(Order{OrderType::GoodForDay, 1, Side::Buy, 101, 10});
+    orderbook.AddOrder(Order{OrderType::GoodForDay, 2, Side::Sell, 100, 4});
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Sell, 105, 4});
+
+    Trades trades;
+    const AuctionResult result = orderbook.Uncross(trades, true);
+    ASSERT_EQ(result.volume_, 4u);
+    ASSERT_EQ(trades.size(), 1u);
+    ASSERT_FALSE(orderbook.Contains(1)); // 6 left, but only for the day
+    ASSERT_TRUE(orderbook.Contains(3));
+    ASSERT_EQ(orderbook.Size(), 1u);
+}
+TEST(IcebergTests, ShowsOnePeakAtATimeAndGoesToTheBackForTheNext) {
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    config.levelUpdates_ = true;
+    Orderbook orderbook{config};
+    orderbook.AddOrder(Order::Iceberg(OrderType::GoodTillCancel, 1, Side::Sell, 100, 100, 30));
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Sell, 100, 10});
+    ASSERT_EQ(orderbook.GetOrderInfos().GetAsks().front().quantity_, 40u); // the 70 behind the peak are not shown
+    ASSERT_EQ(orderbook.GetTopOfBook().askQuantity_, 40u);
+
+    // takes the whole peak, the next one goes behind order 2
+    Trades trades = orderbook.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Buy, 100, 30});
+    ASSERT_EQ(trades.size(), 1u);
+    ASSERT_EQ(trades[0].GetAskTrade().orderId_, 1u);
+    ASSERT_EQ(orderbook.GetOrderInfos().GetAsks().front().quantity_, 40u);
+    trades = orderbook.AddOrder(Order{OrderType::GoodTillCancel, 4, Side::Buy, 100, 15});
+    ASSERT_EQ(trades.size(), 2u);
+    ASSERT_EQ(trades[0].GetAskTrade().orderId_, 2u);
+    ASSERT_EQ(trades[1].GetAskTrade().orderId_, 1u);
+    ASSERT_EQ(trades[1].GetAskTrade().quantity_, 5u);
+    ASSERT_EQ(orderbook.GetOrderInfos().GetAsks().front().quantity_, 25u);
+
+    // what is hidden still trades, a FillOrKill for all 65 left goes through peak by peak
+    trades = orderbook.AddOrder(Order{OrderType::FillOrKill, 5, Side::Buy, 100, 65});
+    ASSERT_EQ(trades.size(), 3u);
+    Quantity filled = 0;
+    for (const auto& trade : trades) {
+        ASSERT_EQ(trade.GetAskTrade().orderId_, 1u);
+        filled += trade.GetAskTrade().quantity_;
+    }
+    ASSERT_EQ(filled, 65u);
+    ASSERT_EQ(orderbook.Size(), 0u);
+
+    // the feed only ever had the displayed quantity, and the level went away at 0
+    LevelUpdates updates;
+    orderbook.DrainLevelUpdates(updates);
+    for (const auto& update : updates)
+        ASSERT_LE(update.quantity_, 40u);
+    ASSERT_EQ(updates.back().count_, 0u);
+
+    // an aggressive iceberg takes everything it can before it rests behind its peak
+    orderbook.AddOrder(Order{OrderType::GoodTillCancel, 6, Side::Sell, 101, 50});
+    trades = orderbook.AddOrder(Order::Iceberg(OrderType::GoodForDay, 7, Side::Buy, 101, 80, 20));
+    ASSERT_EQ(trades.size(), 3u); // 20 + 20 + 10
+    ASSERT_EQ(orderbook.GetOrderInfos().GetBids().front().quantity_, 10u);
+    ASSERT_THROW(Order::Iceberg(OrderType::FillAndKill, 8, Side::Buy, 101, 80, 20), std::logic_error);
+}
+TEST(IcebergTests, AmendsSnapshotsAndTheJournalKeepTheReserve) {
+    const auto directory = std::filesystem::temp_directory_path();
+    const auto journalPath = directory / "orderbook_iceberg_test.journal";
+    const auto snapshotPath = directory / "orderbook_iceberg_test.snapshot";
+    std::filesystem::remove(journalPath);
+
+    OrderbookConfig config;
+    config.pruneThread_ = false;
+    Orderbook live{config};
+    {
+        JournalWriter journal{JournalConfig{journalPath.string(), 64, FsyncPolicy::Never, {}}};
+        live.AttachJournal(&journal);
+        live.AddOrder(Order::Iceberg(OrderType::GoodTillCancel, 1, Side::Buy, 99, 100, 25));
+        live.AddOrder(Order{OrderType::GoodTillCancel, 2, Side::Buy, 99, 5});
+        live.AddOrder(Order{OrderType::GoodTillCancel, 3, Side::Sell, 99, 30}); // one peak, then order 2
+        ASSERT_EQ(live.GetOrderInfos().GetBids().front().quantity_, 25u);
+
+        // 75 left, 40 of it stays: the reserve gives way first, the peak on show is untouched
+        live.ModifyOrder(OrderModify{1, Side::Buy, 99, 40});
+        ASSERT_EQ(live.GetOrderInfos().GetBids().front().quantity_, 25u);
+        live.SaveSnapshot(snapshotPath.string());
+        live.AttachJournal(nullptr);
+    }
+
+    Orderbook replayed{config};
+    ReplayJournal(journalPath.string(), replayed);
+    Orderbook recovered{config};
+    recovered.LoadSnapshot(snapshotPath.string());
+
+    for (Orderbook* orderbook : {&live, &replayed, &recovered}) {
+        ASSERT_EQ(orderbook->GetOrderInfos().GetBids().front().quantity_, 25u);
+        // 40 can trade, not 41
+        ASSERT_TRUE(orderbook->AddOrder(Order{OrderType::FillOrKill, 10, Side::Sell, 99, 41}).empty());
+        const Trades trades = orderbook->AddOrder(Order{OrderType::FillOrKill, 11, Side::Sell, 99, 40});
+        ASSERT_EQ(trades.size(), 2u);
+        ASSERT_EQ(trades[0].GetBidTrade().quantity_, 25u);
+        ASSERT_EQ(trades[1].GetBidTrade().quantity_, 15u);
+        ASSERT_EQ(orderbook->Size(), 0u);
+    }
+    std::filesystem::remove(journalPath);
+    std::filesystem::remove(snapshotPath);
+}
+TEST(FlatOrderIndexTests, AgreesWithAnUnorderedMapThroughChurnAndGrowth) {
+    FlatOrderIndex<int> index;
+    std::unordered_map<OrderId, int> expected;
+    std::mt19937_64 rng{7};
+
+    // mostly dense ids plus some far apart ones, so runs wrap and collide
+    auto RandomId = [&] { return rng() % 4 == 0 ? rng() : rng() % 200; };
+    for (int i = 0; i < 50000; ++i) {
+        const OrderId id = RandomId();
+        if (rng() % 3 == 0) {
+            ASSERT_EQ(index.erase(id), expected.erase(id));
+        } else {
+            const auto [entry, inserted] = index.emplace(id, i);
+            ASSERT_EQ(inserted, expected.emplace(id, i).second);
+            ASSERT_EQ(entry->second, expected.at(id));
+        }
+        ASSERT_EQ(index.size(), expected.size());
+    }
+    for (OrderId id = 0; id < 200; ++id)
+        ASSERT_EQ(index.contains(id), expected.contains(id));
+    for (const auto& [id, value] : expected) {
+        const auto entry = index.find(id);
+        ASSERT_NE(entry, index.end());
+        ASSERT_EQ(entry->second, value);
+    }
+
+    // ids at the same home slot of a full run, erased from the front
+    FlatOrderIndex<int> collided;
+    collided.reserve(8);
+    for (OrderId id = 0; id < 8; ++id)
+        collided.emplace(id * 16, static_cast<int>(id));
+    for (OrderId id = 0; id < 8; ++id) {
+        collided.erase(collided.find(id * 16));
+        for (OrderId rest = id + 1; rest < 8; ++rest)
+            ASSERT_EQ(collided.find(rest * 16)->second, static_cast<int>(rest));
+    }
+    ASSERT_TRUE(collided.empty());
+}
+TEST(CommandParserTests, ParsesLinesInPlaceAndStopsBeforeAPartialLine) {
+    const std::string_view text =
+        "A B GoodTillCancel 100 10 1\r\n"
+        "\n"
+        "# comment\n"
+        "M 1 S -5 20\n"
+        "C 1\n"
+        "P\n"
+        "R 0 0 0\n"
+        "E 123456789\n"
+        "A S Mar";
+
+    CommandParser parser{text, false};
+    Command command;
+    ASSERT_TRUE(parser.Next(command));
+    ASSERT_EQ(command.type_, CommandType::Add);
+    ASSERT_EQ(command.orderType_, OrderType::GoodTillCancel);
+    ASSERT_EQ(command.price_, 100);
+    ASSERT_EQ(command.quantity_, 10u);
+    ASSERT_EQ(command.orderId_, 1u);
+
+    ASSERT_TRUE(parser.Next(command));
+    ASSERT_EQ(command.type_, CommandType::Modify);
+    ASSERT_EQ(command.side_, Side::Sell);
+    ASSERT_EQ(command.price_, -5);
+
+    ASSERT_TRUE(parser.Next(command));
+    ASSERT_EQ(command.type_, CommandType::Cancel);
+    ASSERT_TRUE(parser.Next(command));
+    ASSERT_EQ(command.type_, CommandType::PruneGoodForDay);
+    ASSERT_TRUE(parser.Next(command));
+    ASSERT_EQ(command.type_, CommandType::Expire);
+    ASSERT_EQ(command.time_, 123456789);
+
+    ASSERT_FALSE(parser.Next(command));
+    ASSERT_EQ(parser.Rest(), "A S Mar");
+    ASSERT_EQ(parser.Line(), 9u);
 
-    const auto& infos = orderbook.GetOrderInfos();
-    ASSERT_EQ(orderbook.Size(), result.allCount_);
-    ASSERT_EQ(infos.GetBids().size(), result.bidCount_);
-    ASSERT_EQ(infos.GetAsks().size(), result.askCount_);
+    CommandParser last{parser.Rest(), true, parser.Line()};
+    ASSERT_THROW(last.Next(command), std::invalid_argument);
 }
 
 INSTANTIATE_TEST_SUITE_P(
@@ -211,9 +1776,12 @@ INSTANTIATE_TEST_SUITE_P(
     ::testing::Values(
         "Match_GoodTillCancel.txt",
         "Match_FillAndKill.txt",
+        "Match_FillAndKill_Partial.txt",
         "Match_FillOrKill_Hit.txt",
         "Match_FillOrKill_Miss.txt",
+        "Match_FillOrKill_Depth.txt",
         "Cancel_Success.txt",
+        "Cancel_Middle.txt",
         "Modify_Side.txt",
         "Match_Market.txt"
     )
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "ExecutionReport.h"
+#include "Order.h"
+#include "Usings.h"
+
+/* Pre trade risk checks in front of the book */
+/*
+ * every account has its limits and its running exposure in one flat array, indexed by the
+ * account id, so checking an order is a handful of compares on one cache line
+ *
+ *   position_      filled quantity, bought minus sold
+ *   openBuy_ / openSell_ / openNotional_
+ *                  what the account has resting, price * quantity for the notional
+ *
+ * the book keeps them up to date as it goes: a resting order adds its quantity when it is
+ * accepted, fills move quantity from open to position, cancels, expiries and amends take it off
+ * Market / FillAndKill / FillOrKill orders never rest, they only ever move the position
+ *
+ * an order is rejected, with the reason, when
+ *   its quantity is over maxOrderQuantity_
+ *   its price is more than priceBandBps_ away from the reference (the last trade, or the best
+ *   price on the other side, or on its own side, while nothing has traded yet)
+ *   filling it and everything else the account has open on that side could take the position
+ *   past maxPosition_ either way
+ *   resting it would take the account's open notional past maxOpenNotional_
+ *
+ * limit changes are journaled and snapshots keep every account's position and limits, so a snapshot
+ * plus its journal tail (or the journal from the start) brings them back, open quantities come
+ * back with the resting orders
+ */
+
+struct AccountLimits {
+    std::int64_t maxPosition_ = std::numeric_limits<std::int64_t>::max();
+    std::uint64_t maxOpenNotional_ = std::numeric_limits<std::uint64_t>::max();
+};
+
+struct AccountRisk {
+    std::int64_t position_{0};
+    std::uint64_t openBuy_{0};
+    std::uint64_t openSell_{0};
+    std::uint64_t openNotional_{0};
+};
+
+struct RiskConfig {
+    // off by default, accounts are then not looked at at all
+    bool enabled_ = false;
+    // account ids 0 .. accounts_ - 1 are known, anything else is rejected
+    std::size_t accounts_ = 1024;
+    Quantity maxOrderQuantity_ = std::numeric_limits<Quantity>::max();
+    // fat finger band around the reference price in basis points, 0 = no band
+    std::uint32_t priceBandBps_ = 0;
+    // every account starts with these, SetAccountLimits changes one
+    AccountLimits limits_;
+};
+
+class PreTradeRisk {
+public:
+    explicit PreTradeRisk(const RiskConfig& config)
+    : enabled_{config.enabled_},
+      maxOrderQuantity_{config.maxOrderQuantity_},
+      priceBandBps_{config.priceBandBps_},
+      accounts_(config.enabled_ ? config.accounts_ : 0, Account{{}, config.limits_})
+    {}
+
+    bool Enabled() const {return enabled_;}
+    bool Known(AccountId account) const {return account < accounts_.size();}
+
+    /* std::logic_error while risk is off, no account is kept then, std::out_of_range for an unknown one */
+    void SetLimits(AccountId account, const AccountLimits& limits){At(account).limits_ = limits;}
+    const AccountRisk& Risk(AccountId account) const {return At(account).risk_;}
+    const AccountLimits& Limits(AccountId account) const {return At(account).limits_;}
+
+    /* 0 while risk is off */
+    std::size_t Accounts() const {return accounts_.size();}
+    /* what a snapshot kept of a known account, its open quantities come back as its orders are loaded */
+    void Restore(AccountId account, std::int64_t position, const AccountLimits& limits){
+        accounts_[account].risk_.position_ = position;
+        accounts_[account].limits_ = limits;
+    }
+
+    /* None if a new order may go into the book, reference is InvalidReference when there is none */
+    RejectReason Check(const Order& order, Price reference) const {
+        return Check(order.GetAccount(), order.GetOrderType(), order.GetSide(), order.GetPrice(),
+                     order.GetRemainingQuantity(), reference, nullptr);
+    }
+    /* the same for a resting order moved to side / price / quantity, what it has open now is not counted */
+    RejectReason CheckReplace(const Order& order, Side side, Price price, Quantity quantity, Price reference) const {
+        return Check(order.GetAccount(), order.GetOrderType(), side, price, quantity, reference, &order);
+    }
+
+    /* a resting order's remaining quantity starts to count as open */
+    void OnAccepted(const Order& order){
+        if(!Resting(order.GetOrderType()))
+            return;
+        AccountRisk& risk = accounts_[order.GetAccount()].risk_;
+        (order.GetSide() == Side::Buy ? risk.openBuy_ : risk.openSell_) += order.GetRemainingQuantity();
+        risk.openNotional_ += Notional(order.GetPrice(), order.GetRemainingQuantity());
+    }
+    /* quantity of a resting order that stops counting as open, by a cancel or an amend down */
+    void OnReleased(const Order& order, Quantity quantity){
+        AccountRisk& risk = accounts_[order.GetAccount()].risk_;
+        (order.GetSide() == Side::Buy ? risk.openBuy_ : risk.openSell_) -= quantity;
+        risk.openNotional_ -= Notional(order.GetPrice(), quantity);
+    }
+    void OnFill(const Order& order, Quantity quantity){
+        AccountRisk& risk = accounts_[order.GetAccount()].risk_;
+        risk.position_ += order.GetSide() == Side::Buy ? static_cast<std::int64_t>(quantity) : -static_cast<std::int64_t>(quantity);
+        if(Resting(order.GetOrderType()))
+            OnReleased(order, quantity);
+    }
+
+    static constexpr Price InvalidReference = std::numeric_limits<Price>::min();
+
+private:
+    struct Account {
+        AccountRisk risk_;
+        AccountLimits limits_;
+    };
+
+    const Account& At(AccountId account) const {
+        if(!enabled_)
+            throw std::logic_error("pre trade risk is not enabled, set OrderbookConfig::risk_.enabled_");
+        return accounts_.at(account);
+    }
+    Account& At(AccountId account){
+        return const_cast<Account&>(static_cast<const PreTradeRisk&>(*this).At(account));
+    }
+
+    static bool Resting(OrderType type){
+        return type != OrderType::Market && type != OrderType::FillAndKill && type != OrderType::FillOrKill;
+    }
+    static std::uint64_t Notional(Price price, Quantity quantity){
+        const std::int64_t wide = price;
+        return static_cast<std::uint64_t>(wide < 0 ? -wide : wide) * quantity;
+    }
+
+    RejectReason Check(AccountId accountId, OrderType type, Side side, Price price, Quantity quantity,
+                       Price reference, const Order* replacing) const {
+        if(!Known(accountId))
+            return RejectReason::UnknownAccount;
+        if(quantity > maxOrderQuantity_)
+            return RejectReason::OrderTooLarge;
+
+        const bool priced = type != OrderType::Market;
+        if(priced && priceBandBps_ != 0 && reference != InvalidReference){
+            const std::int64_t distance = static_cast<std::int64_t>(price) - reference;
+            const std::int64_t base = reference < 0 ? -static_cast<std::int64_t>(reference) : reference;
+            if((distance < 0 ? -distance : distance) * 10000 > base * static_cast<std::int64_t>(priceBandBps_))
+                return RejectReason::PriceBand;
+        }
+
+        const Account& account = accounts_[accountId];
+        const AccountRisk& risk = account.risk_;
+        std::uint64_t openBuy = risk.openBuy_, openSell = risk.openSell_, openNotional = risk.openNotional_;
+        if(replacing != nullptr){
+            const Quantity open = replacing->GetRemainingQuantity();
+            (replacing->GetSide() == Side::Buy ? openBuy : openSell) -= open;
+            openNotional -= Notional(replacing->GetPrice(), open);
+        }
+
+        // the worst case, everything open on that side fills
+        const std::int64_t worst = side == Side::Buy
+            ? risk.position_ + static_cast<std::int64_t>(openBuy + quantity)
+            : static_cast<std::int64_t>(openSell + quantity) - risk.position_;
+        if(worst > account.limits_.maxPosition_)
+            return RejectReason::PositionLimit;
+
+        if(Resting(type) && openNotional + Notional(price, quantity) > account.limits_.maxOpenNotional_)
+            return RejectReason::NotionalLimit;
+        return RejectReason::None;
+    }
+
+    bool enabled_;
+    Quantity maxOrderQuantity_;
+    std::uint32_t priceBandBps_;
+    std::vector<Account> accounts_;
+};
@@ -0,0 +1,423 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include "FenwickTree.h"
+#include "LevelData.h"
+#include "OrderQueue.h"
+#include "Side.h"
+#include "Usings.h"
+
+/* One side of the book stored as a price ladder */
+/*
+ * prices inside the window live in a flat array indexed by (price - base) / tick
+ * a bitmap marks which levels exist so finding the next level is a couple of word scans
+ * the best level index is cached so best price is O(1)
+ *
+ * prices outside the window (or off the tick grid) fall back to an ordered map
+ * without a base price the window centres on the first level created, after that it re-centres
+ * when the whole side is empty and a price lands outside it
+ * with zero levels every price goes to the map, which is the plain std::map book
+ *
+ * each level also keeps its LevelData, and a Fenwick tree over the window quantities
+ * answers "how much rests at this price or better" in O(log n) for FillOrKill
+ *
+ * bids are best when highest, asks are best when lowest
+ */
+
+template<Side S>
+class PriceLadder {
+public:
+    using Compare = std::conditional_t<S == Side::Buy, std::greater<Price>, std::less<Price>>;
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    PriceLadder(std::size_t levelCount, Price tickSize, std::optional<Price> basePrice)
+    : levels_(levelCount), bitmap_((levelCount + 63) / 64), depth_{levelCount},
+      tick_{tickSize > 0 ? tickSize : 1}, base_{basePrice.value_or(0)}, centred_{basePrice.has_value()}
+    {}
+    PriceLadder(const PriceLadder&) = delete;
+    PriceLadder& operator=(const PriceLadder&) = delete;
+
+    bool Empty() const {return count_ == 0 && overflow_.empty();}
+    /* number of price levels on this side */
+    std::size_t Size() const {return count_ + overflow_.size();}
+    /* levels that fell outside the window */
+    std::size_t OverflowSize() const {return overflow_.size();}
+
+    /* side must not be empty */
+    Price BestPrice() const {
+        if(UseWindowBest())
+            return PriceAt(best_);
+        return overflow_.begin()->first;
+    }
+
+    OrderQueue& BestLevel() {
+        if(UseWindowBest())
+            return levels_[best_].orders_;
+        return overflow_.begin()->second.orders_;
+    }
+
+    const OrderQueue& BestLevel() const {
+        return const_cast<PriceLadder*>(this)->BestLevel();
+    }
+
+    /* aggregates of the best level, side must not be empty */
+    const LevelData& BestData() const {
+        if(UseWindowBest())
+            return levels_[best_].data_;
+        return overflow_.begin()->second.data_;
+    }
+
+    /* side must not be empty */
+    Price WorstPrice() const {
+        const std::size_t worst = S == Side::Buy ? FindNext(0) : FindPrev(levels_.size() - 1);
+        if(worst == npos)
+            return overflow_.rbegin()->first;
+        if(overflow_.empty() || Better(overflow_.rbegin()->first, PriceAt(worst)))
+            return PriceAt(worst);
+        return overflow_.rbegin()->first;
+    }
+
+    /* level must exist */
+    OrderQueue& At(Price price){
+        std::size_t index;
+        if(ToIndex(price, index))
+            return levels_[index].orders_;
+        return overflow_.at(price).orders_;
+    }
+
+    /* level must exist */
+    const LevelData& Data(Price price) const {
+        std::size_t index;
+        if(ToIndex(price, index))
+            return levels_[index].data_;
+        return overflow_.at(price).data_;
+    }
+
+    /* level must exist */
+    /* returns the level's aggregates after the update */
+    /* quantity is the displayed part of the change and hidden the iceberg reserve that goes with it,
+     * fills only ever take displayed quantity and REFRESH moves quantity from hidden to displayed
+     * the cumulative depth counts both, it is what can trade
+     */
+    const LevelData& UpdateLevelData(Price price, Quantity quantity, LevelData::Action action, Quantity hidden = 0){
+        std::size_t index;
+        const bool inWindow = ToIndex(price, index);
+        LevelData& data = inWindow ? levels_[index].data_ : overflow_.at(price).data_;
+
+        if(action==LevelData::Action::REFRESH){
+            data.quantity_ += quantity;
+            data.hidden_ -= quantity;
+            return data;
+        }
+        data.count_ += action==LevelData::Action::REMOVE ? -1 : action==LevelData::Action::ADD ? 1 : 0;
+
+        const bool adding = action==LevelData::Action::ADD;
+        if(adding){
+            data.quantity_ += quantity;
+            data.hidden_ += hidden;
+        }
+        else{
+            data.quantity_ -= quantity;
+            data.hidden_ -= hidden;
+        }
+
+        const std::int64_t total = static_cast<std::int64_t>(quantity) + hidden;
+        if(inWindow)
+            depth_.Add(index, adding ? total : -total);
+        return data;
+    }
+
+    /* quantity resting at limit or better, hidden included */
+    std::uint64_t DepthAt(Price limit) const {
+        std::uint64_t depth = WindowDepth(limit);
+        for(const auto& [price, level] : overflow_){
+            if(Better(limit, price))
+                break;
+            depth += static_cast<std::uint64_t>(level.data_.quantity_) + level.data_.hidden_;
+        }
+        return depth;
+    }
+
+    /* lowest level priced at or above price, false if there is none (by price, whichever side) */
+    bool LevelAtOrAbove(Price price, Price& level) const {
+        bool found = false;
+        const std::int64_t offset = static_cast<std::int64_t>(price) - base_;
+        if(!levels_.empty() && offset < static_cast<std::int64_t>(levels_.size()) * tick_){
+            const std::int64_t first = offset <= 0 ? 0 : (offset + tick_ - 1) / tick_;
+            const std::size_t index = FindNext(static_cast<std::size_t>(first));
+            if(index != npos){
+                level = PriceAt(index);
+                found = true;
+            }
+        }
+        // asks are kept lowest first, bids highest first
+        auto overflow = S == Side::Sell ? overflow_.lower_bound(price) : overflow_.upper_bound(price);
+        if constexpr (S == Side::Buy){
+            if(overflow == overflow_.begin())
+                return found;
+            --overflow;
+        }
+        else if(overflow == overflow_.end())
+            return found;
+        if(!found || overflow->first < level)
+            level = overflow->first;
+        return true;
+    }
+
+    /* highest level priced below price, false if there is none */
+    bool LevelBelow(Price price, Price& level) const {
+        bool found = false;
+        const std::int64_t offset = static_cast<std::int64_t>(price) - base_;
+        if(!levels_.empty() && offset > 0){
+            const auto last = std::min((offset - 1) / tick_, static_cast<std::int64_t>(levels_.size()) - 1);
+            const std::size_t index = FindPrev(static_cast<std::size_t>(last));
+            if(index != npos){
+                level = PriceAt(index);
+                found = true;
+            }
+        }
+        auto overflow = S == Side::Sell ? overflow_.lower_bound(price) : overflow_.upper_bound(price);
+        if constexpr (S == Side::Sell){
+            if(overflow == overflow_.begin())
+                return found;
+            --overflow;
+        }
+        else if(overflow == overflow_.end())
+            return found;
+        if(!found || overflow->first > level)
+            level = overflow->first;
+        return true;
+    }
+
+    /* is there at least quantity resting at limit or better, hidden included */
+    bool HasDepth(Price limit, Quantity quantity) const {
+        std::uint64_t available = WindowDepth(limit);
+        if(available >= quantity)
+            return true;
+
+        // overflow levels are few, walk them best first until we pass the limit
+        for(const auto& [price, level] : overflow_){
+            if(Better(limit, price))
+                break;
+            available += static_cast<std::uint64_t>(level.data_.quantity_) + level.data_.hidden_;
+            if(available >= quantity)
+                return true;
+        }
+        return false;
+    }
+
+    bool Contains(Price price) const {
+        std::size_t index;
+        if(ToIndex(price, index))
+            return IsSet(index);
+        return overflow_.contains(price);
+    }
+
+    /* like map operator[], creates the level if it is not there yet */
+    OrderQueue& GetOrCreate(Price price){
+        std::size_t index;
+        if(Empty() && (!centred_ || !ToIndex(price, index)))
+            Recenter(price);
+
+        if(!ToIndex(price, index))
+            return overflow_[price].orders_;
+
+        if(!IsSet(index)){
+            Set(index);
+            ++count_;
+            if(best_ == npos || Better(PriceAt(index), PriceAt(best_)))
+                best_ = index;
+        }
+        return levels_[index].orders_;
+    }
+
+    /* remove an empty level */
+    void Erase(Price price){
+        std::size_t index;
+        if(!ToIndex(price, index)){
+            overflow_.erase(price);
+            return;
+        }
+        if(!IsSet(index))
+            return;
+
+        Clear(index);
+        --count_;
+        if(index == best_)
+            best_ = NextWorse(index);
+    }
+
+    /* visit levels best to worst: function(Price, const OrderQueue&) */
+    template<typename Function>
+    void ForEachLevel(Function function) const {
+        Walk([&function](Price price, const Level& level){
+            function(price, level.orders_);
+            return true;
+        });
+    }
+
+    /* visit the aggregates of at most maxLevels levels best to worst: function(Price, const LevelData&)
+     * never touches the orders, so it costs the number of levels visited
+     */
+    template<typename Function>
+    void ForEachLevelData(std::size_t maxLevels, Function function) const {
+        Walk([&function, &maxLevels](Price price, const Level& level){
+            if(maxLevels == 0)
+                return false;
+            --maxLevels;
+            function(price, level.data_);
+            return true;
+        });
+    }
+
+    /* the same for every level at limit or better */
+    template<typename Function>
+    void ForEachLevelDataUpTo(Price limit, Function function) const {
+        Walk([&function, limit](Price price, const Level& level){
+            if(Better(limit, price))
+                return false;
+            function(price, level.data_);
+            return true;
+        });
+    }
+
+private:
+    struct Level {
+        OrderQueue orders_;
+        LevelData data_;
+    };
+
+    static bool Better(Price lhs, Price rhs) {return Compare{}(lhs, rhs);}
+
+    /* merge window and overflow best to worst, visit(Price, const Level&) returns false to stop */
+    template<typename Visit>
+    void Walk(Visit visit) const {
+        auto overflow = overflow_.begin();
+        std::size_t index = best_;
+        while(index != npos || overflow != overflow_.end()){
+            if(index != npos && (overflow == overflow_.end() || Better(PriceAt(index), overflow->first))){
+                if(!visit(PriceAt(index), levels_[index]))
+                    return;
+                index = NextWorse(index);
+            }
+            else{
+                if(!visit(overflow->first, overflow->second))
+                    return;
+                ++overflow;
+            }
+        }
+    }
+
+    bool UseWindowBest() const {
+        return best_ != npos && (overflow_.empty() || Better(PriceAt(best_), overflow_.begin()->first));
+    }
+
+    bool ToIndex(Price price, std::size_t& index) const {
+        if(levels_.empty())
+            return false;
+        const std::int64_t offset = static_cast<std::int64_t>(price) - base_;
+        if(offset < 0 || offset % tick_ != 0)
+            return false;
+        const auto slot = static_cast<std::uint64_t>(offset / tick_);
+        if(slot >= levels_.size())
+            return false;
+        index = static_cast<std::size_t>(slot);
+        return true;
+    }
+
+    /* quantity in window slots priced at limit or better */
+    std::uint64_t WindowDepth(Price limit) const {
+        if(levels_.empty())
+            return 0;
+
+        const std::int64_t offset = static_cast<std::int64_t>(limit) - base_;
+        const auto slots = static_cast<std::int64_t>(levels_.size());
+        if constexpr (S == Side::Sell){
+            // asks at or below the limit are the first slots
+            if(offset < 0)
+                return 0;
+            const auto count = std::min(offset / tick_ + 1, slots);
+            return depth_.PrefixSum(count);
+        }
+        else{
+            // bids at or above the limit are the last slots
+            const auto first = offset <= 0 ? 0 : (offset + tick_ - 1) / tick_;
+            if(first >= slots)
+                return 0;
+            return depth_.PrefixSum(slots) - depth_.PrefixSum(first);
+        }
+    }
+
+    Price PriceAt(std::size_t index) const {
+        return static_cast<Price>(base_ + static_cast<std::int64_t>(index) * tick_);
+    }
+
+    /* only called when the side is empty so nothing has to move */
+    void Recenter(Price price){
+        centred_ = true;
+        if(levels_.empty())
+            return;
+        base_ = static_cast<std::int64_t>(price) - static_cast<std::int64_t>(levels_.size() / 2) * tick_;
+        best_ = npos;
+    }
+
+    std::size_t NextWorse(std::size_t index) const {
+        if constexpr (S == Side::Buy)
+            return index == 0 ? npos : FindPrev(index - 1);
+        else
+            return FindNext(index + 1);
+    }
+
+    bool IsSet(std::size_t index) const {return (bitmap_[index / 64] >> (index % 64)) & 1;}
+    void Set(std::size_t index) {bitmap_[index / 64] |= std::uint64_t{1} << (index % 64);}
+    void Clear(std::size_t index) {bitmap_[index / 64] &= ~(std::uint64_t{1} << (index % 64));}
+
+    /* lowest existing level at or above index */
+    std::size_t FindNext(std::size_t index) const {
+        std::size_t word = index / 64;
+        if(word >= bitmap_.size())
+            return npos;
+        std::uint64_t bits = bitmap_[word] & (~std::uint64_t{0} << (index % 64));
+        while(true){
+            if(bits)
+                return word * 64 + std::countr_zero(bits);
+            if(++word == bitmap_.size())
+                return npos;
+            bits = bitmap_[word];
+        }
+    }
+
+    /* highest existing level at or below index */
+    std::size_t FindPrev(std::size_t index) const {
+        if(bitmap_.empty())
+            return npos;
+        std::size_t word = index / 64;
+        std::uint64_t bits = bitmap_[word] & (~std::uint64_t{0} >> (63 - index % 64));
+        while(true){
+            if(bits)
+                return word * 64 + 63 - std::countl_zero(bits);
+            if(word-- == 0)
+                return npos;
+            bits = bitmap_[word];
+        }
+    }
+
+    std::vector<Level> levels_;
+    std::vector<std::uint64_t> bitmap_;
+    FenwickTree depth_;
+    std::map<Price, Level, Compare> overflow_;
+    std::int64_t tick_;
+    std::int64_t base_;
+    bool centred_; // false until the first level when no base price was given
+    std::size_t best_{npos};
+    std::size_t count_{0};
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+/* One writer, any number of readers, nobody waits on a lock */
+/*
+ * the writer bumps the sequence to odd, stores the value a word at a time and bumps it back to even
+ * a reader copies the words out between two reads of the sequence and tries again if they differ
+ * or a store was under way, so it never sees half of one value and half of another
+ *
+ * the writer never waits for readers, readers only spin while a store is actually in progress
+ * every word is an atomic so copying out while the writer stores is not a data race
+ */
+
+template<typename T>
+class alignas(64) Seqlock { // its own cache lines, readers do not share them with what the writer works on
+    static_assert(std::is_trivially_copyable_v<T>);
+    static constexpr std::size_t Words = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+public:
+    /* only ever from one thread at a time (the book does it under its lock) */
+    void Store(const T& value){
+        std::array<std::uint64_t, Words> words{};
+        std::memcpy(words.data(), &value, sizeof(T));
+
+        const std::uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+        sequence_.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for(std::size_t i = 0; i < Words; ++i)
+            words_[i].store(words[i], std::memory_order_relaxed);
+        sequence_.store(sequence + 2, std::memory_order_release);
+    }
+
+    T Load() const {
+        std::array<std::uint64_t, Words> words;
+        while(true){
+            const std::uint64_t before = sequence_.load(std::memory_order_acquire);
+            if((before & 1) == 0){
+                for(std::size_t i = 0; i < Words; ++i)
+                    words[i] = words_[i].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(sequence_.load(std::memory_order_relaxed) == before)
+                    break;
+            }
+#if defined(__x86_64__) || defined(_M_X64)
+            _mm_pause();
+#endif
+        }
+
+        T value;
+        std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+        return value;
+    }
+
+    /* how many stores have completed */
+    std::uint64_t Version() const {return sequence_.load(std::memory_order_acquire) / 2;}
+
+private:
+    std::atomic<std::uint64_t> sequence_{0};
+    std::array<std::atomic<std::uint64_t>, Words> words_{};
+};
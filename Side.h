@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstdint>
+
 /* enum for Side of the order */
-enum class Side {
+enum class Side : std::uint8_t {
     Buy,
     Sell
 };
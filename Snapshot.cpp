@@ -0,0 +1,193 @@
+#include "Orderbook.h"
+#include "Journal.h"
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr char Magic[8] = {'O', 'B', 'S', 'N', 'A', 'P', 'S', 'H'};
+constexpr std::uint32_t Version = 5; // 3 keeps the iceberg peak where other types have no deadline, 4 the accounts, 5 the auction phase
+
+SnapshotRecord ToRecord(const Order& order)
+{
+    return SnapshotRecord{
+        order.GetOrderId(),
+        order.GetPrice(),
+        order.GetInitialQuantity(),
+        order.GetRemainingQuantity(),
+        static_cast<std::uint8_t>(order.GetOrderType()),
+        0,
+        order.GetAccount(),
+        order.GetOrderType() == OrderType::GoodTillTime ? order.GetExpiry() : static_cast<std::int64_t>(order.GetPeak()),
+    };
+}
+
+}
+
+/* take the lock once, copy every resting order out in book order, write it in one go
+ * the file is written next to the target and renamed over it, so a crash mid write
+ * never leaves a half snapshot where a good one used to be
+ */
+template<typename Policy>
+std::uint64_t BasicOrderbook<Policy>::SaveSnapshot(const std::string& path) const
+{
+    SnapshotHeader header{};
+    std::vector<SnapshotRecord> records;
+    std::vector<SnapshotAccount> accounts;
+    {
+        std::scoped_lock ordersLock{ordersMutex_};
+        records.reserve(orders_.size());
+
+        auto Collect = [&records](Price, const OrderQueue& orders){
+            for(const Order& order : orders)
+                records.push_back(ToRecord(order));
+        };
+        bids_.ForEachLevel(Collect);
+        header.bidCount_ = records.size();
+        asks_.ForEachLevel(Collect);
+
+        // positions come from fills before the snapshot, a journal tail replayed onto it cannot rebuild them
+        accounts.reserve(risk_.Accounts());
+        for(std::size_t account = 0; account < risk_.Accounts(); ++account){
+            const auto id = static_cast<AccountId>(account);
+            const AccountLimits& limits = risk_.Limits(id);
+            accounts.push_back(SnapshotAccount{risk_.Risk(id).position_, limits.maxPosition_, limits.maxOpenNotional_});
+        }
+
+        std::memcpy(header.magic_, Magic, sizeof(Magic));
+        header.version_ = Version;
+        header.recordSize_ = sizeof(SnapshotRecord);
+        // a record still in the writer's batch would be lost in a crash and then numbered again by the
+        // next writer, below the sequence the snapshot says it covers, so write the batch out first
+        if(journal_ != nullptr)
+            journal_->Flush();
+        header.journalSequence_ = journal_ != nullptr ? journal_->NextSequence() : 0;
+        header.orderCount_ = records.size();
+        header.priceVolumeSum_ = priceVolumeSum_;
+        header.lastTradedPrice_ = lastTradedPrice_;
+        header.totalVolumeTraded_ = totalVolumeTraded_;
+        header.accountCount_ = accounts.size();
+        header.auction_ = auction_ ? 1 : 0;
+    }
+
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out{temporary, std::ios::binary | std::ios::trunc};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(records.data()),
+                  static_cast<std::streamsize>(records.size() * sizeof(SnapshotRecord)));
+        out.write(reinterpret_cast<const char*>(accounts.data()),
+                  static_cast<std::streamsize>(accounts.size() * sizeof(SnapshotAccount)));
+        if(!out.flush())
+            throw std::runtime_error("cannot write snapshot " + temporary);
+    }
+    std::filesystem::rename(temporary, path);
+    return header.journalSequence_;
+}
+
+/* bulk load into an empty book
+ * records come grouped by level in FIFO order, so each level is looked up once and the
+ * orders are linked straight onto it, no admission checks and no matching
+ */
+template<typename Policy>
+std::uint64_t BasicOrderbook<Policy>::LoadSnapshot(const std::string& path)
+{
+    std::ifstream in{path, std::ios::binary};
+    SnapshotHeader header{};
+    if(!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic_, Magic, sizeof(Magic)) != 0
+        || header.version_ != Version || header.recordSize_ != sizeof(SnapshotRecord)
+        || header.bidCount_ > header.orderCount_)
+        throw std::runtime_error("snapshot " + path + " has an unknown format");
+
+    std::vector<SnapshotRecord> records(header.orderCount_);
+    std::vector<SnapshotAccount> accounts(header.accountCount_);
+    if(!in.read(reinterpret_cast<char*>(records.data()),
+                static_cast<std::streamsize>(records.size() * sizeof(SnapshotRecord)))
+        || !in.read(reinterpret_cast<char*>(accounts.data()),
+                    static_cast<std::streamsize>(accounts.size() * sizeof(SnapshotAccount))))
+        throw std::runtime_error("snapshot " + path + " is truncated");
+    if(risk_.Enabled()){
+        for(const auto& record : records)
+            if(!risk_.Known(record.account_))
+                throw std::runtime_error("snapshot " + path + " has orders of an account the risk checks do not know");
+        for(std::size_t account = risk_.Accounts(); account < accounts.size(); ++account)
+            if(accounts[account].position_ != 0)
+                throw std::runtime_error("snapshot " + path + " has a position of an account the risk checks do not know");
+    }
+
+    std::scoped_lock ordersLock{ordersMutex_};
+    if(!orders_.empty())
+        throw std::logic_error("snapshots can only be loaded into an empty book");
+
+    pool_.Reserve(records.size());
+    orders_.reserve(records.size());
+    // accounts a snapshot taken without risk does not have keep their configured limits and no position
+    for(std::size_t account = 0; account < std::min(accounts.size(), risk_.Accounts()); ++account){
+        const SnapshotAccount& saved = accounts[account];
+        risk_.Restore(static_cast<AccountId>(account), saved.position_, AccountLimits{saved.maxPosition_, saved.maxOpenNotional_});
+    }
+
+    auto Load = [this](auto& ladder, Side side, const SnapshotRecord* begin, const SnapshotRecord* end){
+        OrderQueue* level = nullptr;
+        Price levelPrice{};
+        for(const auto* record = begin; record != end; ++record){
+            const auto type = static_cast<OrderType>(record->orderType_);
+            Order order = type != OrderType::GoodTillTime && record->expiry_ != 0
+                ? Order::Iceberg(type, record->orderId_, side, record->price_, record->initialQuantity_,
+                                 static_cast<Quantity>(record->expiry_), record->account_)
+                : Order{type, record->orderId_, side, record->price_, record->initialQuantity_, record->expiry_, record->account_};
+            order.Fill(record->initialQuantity_ - record->remainingQuantity_);
+
+            if(level == nullptr || record->price_ != levelPrice){
+                level = &ladder.GetOrCreate(record->price_);
+                levelPrice = record->price_;
+            }
+            OrderNode* node = pool_.Acquire(order);
+            level->PushBack(node);
+            const Quantity shown = order.GetDisplayedQuantity();
+            ladder.UpdateLevelData(record->price_, shown, LevelData::Action::ADD, record->remainingQuantity_ - shown);
+            orders_.emplace(record->orderId_, OrderEntry{node, ScheduleExpiry(node->order_)});
+            if(risk_.Enabled())
+                risk_.OnAccepted(node->order_); // open again, the position was restored above
+        }
+    };
+    const SnapshotRecord* bids = records.data();
+    const SnapshotRecord* asks = bids + header.bidCount_;
+    Load(bids_, Side::Buy, bids, asks);
+    Load(asks_, Side::Sell, asks, bids + records.size());
+    if(publishLevelUpdates_){
+        // one update per level, a feed that follows the deltas sees the loaded levels like any other change
+        auto Emit = [this](Side side){
+            return [this, side](Price price, const LevelData& data){
+                levelUpdates_.push_back(LevelUpdate{side, price, data.quantity_, data.count_});
+            };
+        };
+        bids_.ForEachLevelData(std::numeric_limits<std::size_t>::max(), Emit(Side::Buy));
+        asks_.ForEachLevelData(std::numeric_limits<std::size_t>::max(), Emit(Side::Sell));
+    }
+
+    lastTradedPrice_ = header.lastTradedPrice_;
+    totalVolumeTraded_ = header.totalVolumeTraded_;
+    priceVolumeSum_ = header.priceVolumeSum_;
+    // the AuctionStart is before the journal sequence, the tail's uncross needs the book still in the auction
+    auction_ = header.auction_ != 0;
+    indicative_ = {};
+    // the levels went in through the ladders directly, so say they changed for the depth readers
+    depthChanged_ = true;
+    indicativeChanged_ = true;
+    PublishMarketData();
+    return header.journalSequence_;
+}
+
+template std::uint64_t BasicOrderbook<DefaultOrderbookPolicy>::SaveSnapshot(const std::string&) const;
+template std::uint64_t BasicOrderbook<DefaultOrderbookPolicy>::LoadSnapshot(const std::string&);
+template std::uint64_t BasicOrderbook<SingleThreadedOrderbookPolicy>::SaveSnapshot(const std::string&) const;
+template std::uint64_t BasicOrderbook<SingleThreadedOrderbookPolicy>::LoadSnapshot(const std::string&);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include "Usings.h"
+
+/* Point in time book snapshot, on disk layout */
+/*
+ * a header with the market stats, the auction phase and the journal sequence the snapshot was taken at,
+ * then one record per resting order, bids best first then asks best first,
+ * each level in its FIFO order so loading it back keeps time priority,
+ * then the position and limits of every account the pre trade risk checks keep (none while risk is off)
+ *
+ * restart = load the snapshot + replay the journal from its sequence (see Journal.h)
+ * writing and loading live in Snapshot.cpp as Orderbook::SaveSnapshot / LoadSnapshot
+ */
+
+struct SnapshotHeader {
+    char magic_[8];
+    std::uint32_t version_;
+    std::uint32_t recordSize_;
+    std::uint64_t journalSequence_; // first journal record not contained in the snapshot
+    std::uint64_t orderCount_;
+    std::uint64_t bidCount_;        // the first bidCount_ records are bids
+    std::uint64_t priceVolumeSum_;
+    std::int32_t lastTradedPrice_;
+    std::uint32_t totalVolumeTraded_;
+    std::uint64_t accountCount_;    // SnapshotAccount records after the orders, by account id
+    std::uint32_t auction_;         // 1 when taken during a call auction, the book may be crossed
+    std::uint32_t reserved_;
+};
+static_assert(sizeof(SnapshotHeader) == 72);
+
+struct SnapshotRecord {
+    std::uint64_t orderId_;
+    std::int32_t price_;
+    std::uint32_t initialQuantity_;
+    std::uint32_t remainingQuantity_;
+    std::uint8_t orderType_;
+    std::uint8_t reserved_;
+    std::uint16_t account_; // 0 in snapshots from before accounts, the same as not setting one
+    std::int64_t expiry_; // GoodTillTime deadline, for the other types the iceberg peak (0 if it is not one)
+};
+static_assert(sizeof(SnapshotRecord) == 32, "snapshot records are fixed size on disk");
+
+struct SnapshotAccount {
+    std::int64_t position_;
+    std::int64_t maxPosition_;
+    std::uint64_t maxOpenNotional_;
+};
+static_assert(sizeof(SnapshotAccount) == 24);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <vector>
+
+/* Bounded single producer / single consumer ring buffer */
+/*
+ * one thread pushes, one other thread pops, nobody locks
+ * head and tail sit on their own cache lines and each side caches the other's index
+ * so in steady state a push or pop touches only its own line
+ *
+ * capacity is rounded up to a power of two so wrapping is a mask
+ */
+
+template<typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(std::size_t capacity)
+    : buffer_(std::bit_ceil(capacity < 2 ? std::size_t{2} : capacity)), mask_{buffer_.size() - 1}
+    {}
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /* producer side, false when full */
+    bool TryPush(const T& value){
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if(tail - headCache_ == buffer_.size()){
+            headCache_ = head_.load(std::memory_order_acquire);
+            if(tail - headCache_ == buffer_.size())
+                return false;
+        }
+        buffer_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* consumer side, false when empty */
+    bool TryPop(T& value){
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if(head == tailCache_){
+            tailCache_ = tail_.load(std::memory_order_acquire);
+            if(head == tailCache_)
+                return false;
+        }
+        value = buffer_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t Capacity() const {return buffer_.size();}
+
+private:
+    static constexpr std::size_t CacheLine = 64;
+
+    std::vector<T> buffer_;
+    std::size_t mask_;
+
+    alignas(CacheLine) std::atomic<std::size_t> head_{0}; // written by consumer
+    std::size_t tailCache_{0};                             // consumer's copy of tail_
+    alignas(CacheLine) std::atomic<std::size_t> tail_{0}; // written by producer
+    std::size_t headCache_{0};                             // producer's copy of head_
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "Usings.h"
+
+/* L1 and market stats as the book last published them (see Orderbook::GetTopOfBook) */
+/*
+ * quantities are the whole best level, an empty side has quantity 0 and price 0
+ * every field comes from the same moment of the book
+ * during a call auction the book can be crossed, the indicative uncross is what would trade now
+ */
+
+struct TopOfBook {
+    Price bestBid_{};
+    Quantity bidQuantity_{};
+    Price bestAsk_{};
+    Quantity askQuantity_{};
+    Price lastTradedPrice_{};
+    Quantity totalVolumeTraded_{};
+    std::uint64_t priceVolumeSum_{};
+    std::uint64_t orders_{};
+    std::uint32_t bidLevels_{};
+    std::uint32_t askLevels_{};
+    Price indicativePrice_{};
+    bool auction_{false};
+    std::uint64_t indicativeVolume_{}; // 0 outside an auction or while nothing crosses
+
+    bool HasBid() const {return bidQuantity_ != 0;}
+    bool HasAsk() const {return askQuantity_ != 0;}
+    double Vwap() const {
+        return totalVolumeTraded_ == 0 ? 0.0 : static_cast<double>(priceVolumeSum_) / totalVolumeTraded_;
+    }
+
+    bool operator==(const TopOfBook&) const = default;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include "Trade.h"
+
+/* Where the book reports fills */
+/*
+ * a non owning reference to a callable taking const Trade&, or to a Trades buffer the
+ * caller keeps around (its capacity is reused from call to call, so it stops allocating)
+ * the matching loop hands every fill straight to it, no vector is built per call
+ *
+ * it is called with the book locked, so it must not call back into the same book
+ * and it must outlive the call it is passed to, which a temporary lambda does
+ */
+
+class TradeSink {
+public:
+    template<typename Function>
+        requires (!std::is_same_v<std::remove_cvref_t<Function>, TradeSink>)
+              && std::is_invocable_v<Function&, const Trade&>
+    TradeSink(Function&& function)
+    : object_{const_cast<void*>(static_cast<const void*>(std::addressof(function)))},
+      call_{[](void* object, const Trade& trade){
+          (*static_cast<std::remove_reference_t<Function>*>(object))(trade);
+      }}
+    {}
+
+    TradeSink(Trades& trades)
+    : object_{&trades},
+      call_{[](void* object, const Trade& trade){
+          static_cast<Trades*>(object)->push_back(trade);
+      }}
+    {}
+
+    void operator()(const Trade& trade) const {call_(object_, trade);}
+
+private:
+    void* object_;
+    void (*call_)(void*, const Trade&);
+};
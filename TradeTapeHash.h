@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include "Trade.h"
+
+/* FNV-1a over every trade's fields, in the order they happen */
+/*
+ * the same commands give the same value on any build that matches the same way, whichever
+ * path applied them (one at a time or in batches), the driver prints it and the tests pin it
+ */
+
+class TradeTapeHash {
+public:
+    void Add(const Trade& trade){
+        Mix(trade.GetBidTrade().orderId_);
+        Mix(static_cast<std::uint64_t>(trade.GetBidTrade().price_));
+        Mix(trade.GetAskTrade().orderId_);
+        Mix(static_cast<std::uint64_t>(trade.GetAskTrade().price_));
+        Mix(trade.GetBidTrade().quantity_);
+        ++trades_;
+    }
+
+    void operator()(const Trade& trade){Add(trade);}
+
+    std::uint64_t Value() const {return hash_;}
+    std::uint64_t Trades() const {return trades_;}
+
+private:
+    void Mix(std::uint64_t value){
+        for(int byte = 0; byte < 8; ++byte){
+            hash_ ^= (value >> (8 * byte)) & 0xff;
+            hash_ *= 0x100000001b3ull;
+        }
+    }
+
+    std::uint64_t hash_{0xcbf29ce484222325ull};
+    std::uint64_t trades_{0};
+};
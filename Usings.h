@@ -10,3 +10,9 @@ using Quantity = std::uint32_t; // should be positive
 // order ids
 using OrderId = std::uint64_t;
 using OrderIds = std::vector<OrderId>;
+// one orderbook per instrument
+using InstrumentId = std::uint32_t;
+// who an order is for, pre trade risk keeps one entry per account (see PreTradeRisk.h)
+using AccountId = std::uint16_t;
+// wall clock time in nanoseconds since the epoch, what order deadlines are given in
+using Timestamp = std::int64_t;
@@ -25,6 +25,7 @@ OrderType SelectOrderType() {
     std::cout << "3. FillOrKill\n";
     std::cout << "4. GoodForDay\n";
     std::cout << "5. Market\n";
+    std::cout << "6. GoodTillTime\n";
     int choice;
     std::cin >> choice;
     switch (choice) {
@@ -33,6 +34,7 @@ OrderType SelectOrderType() {
         case 3: return OrderType::FillOrKill;
         case 4: return OrderType::GoodForDay;
         case 5: return OrderType::Market;
+        case 6: return OrderType::GoodTillTime;
         default:
             std::cout << "Invalid choice, defaulting to GoodTillCancel.\n";
             return OrderType::GoodTillCancel;
@@ -75,8 +77,24 @@ int main() {
             std::cin >> quantity;
 
 
+            Timestamp expiry{};
+            if (type == OrderType::GoodTillTime) {
+                std::cout << "Expires in (seconds): ";
+                long long seconds;
+                std::cin >> seconds;
+                const auto deadline = std::chrono::system_clock::now() + std::chrono::seconds(seconds);
+                expiry = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+            }
+            Quantity peak{};
+            if (type == OrderType::GoodTillCancel || type == OrderType::GoodForDay) {
+                std::cout << "Show at most (0 shows it all): ";
+                std::cin >> peak;
+            }
+
             auto start = std::chrono::high_resolution_clock::now();
-            auto order = std::make_shared<Order>(type, nextOrderId, side, price, quantity);
+            auto order = peak != 0
+                ? std::make_shared<Order>(Order::Iceberg(type, nextOrderId, side, price, quantity, peak))
+                : std::make_shared<Order>(type, nextOrderId, side, price, quantity, expiry);
             auto trades = ob.AddOrder(order);
             auto end = std::chrono::high_resolution_clock::now();
 